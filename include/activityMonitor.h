@@ -0,0 +1,54 @@
+#ifndef ACTIVITY_MONITOR_H
+#define ACTIVITY_MONITOR_H
+
+#include <X11/Xlib.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "frame.h"
+
+namespace screen_recorder
+{
+    // Decides how often a time-lapse recording samples. It idles at a low
+    // rate and switches to the full rate as soon as a sampled frame differs
+    // noticeably from the previous one or the pointer or keyboard is used,
+    // then drops back once nothing has happened for a few seconds. The rate
+    // decision uses a sparse per-tile signature; whether a frame changed at
+    // all is decided over every row, so a one-line update is never dropped.
+    class ActivityMonitor
+    {
+    public:
+        // Without a display only content changes count as activity
+        ActivityMonitor(int fps, int idleFps, Display *display = nullptr);
+
+        // Compares the frame with the previous sample. Returns false when
+        // nothing changed, i.e. the frame does not need to be encoded.
+        bool sample(const Frame &frame);
+        // Sleeps until `deadline` while watching the pointer and keyboard.
+        // Returns true when input cut the wait short.
+        bool waitUntil(std::chrono::steady_clock::time_point deadline);
+        // Capture ticks of the output rate until the next sample
+        int tickStep() const;
+        bool isActive() const { return mActive; }
+
+    private:
+        // Reads the pointer and keyboard, true if they differ from the last read
+        bool inputChanged();
+        void markActivity(const char *reason);
+
+        int mFps;
+        int mIdleFps;
+        Display *mDisplay;
+        bool mActive;
+        std::chrono::steady_clock::time_point mLastActivity;
+        std::chrono::steady_clock::time_point mLastInputPoll;
+        std::vector<uint64_t> mSignature;
+        std::vector<uint64_t> mPreviousSignature;
+        uint64_t mPreviousRowsHash; // of the rows the signature skips
+        int mPointerX;
+        int mPointerY;
+        unsigned int mPointerMask;
+        char mKeys[32];
+    };
+}
+#endif // ACTIVITY_MONITOR_H
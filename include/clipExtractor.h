@@ -0,0 +1,17 @@
+#ifndef CLIP_EXTRACTOR_H
+#define CLIP_EXTRACTOR_H
+
+#include <string>
+
+namespace screen_recorder
+{
+    // Copies [startSeconds, endSeconds) of a recording's video stream into
+    // `output` without decoding. The clip starts at the last keyframe at or
+    // before startSeconds, found through the recording's keyframe index when
+    // it has one (see keyframeIndex.h), so it may begin up to one GOP early.
+    // The index's byte offsets are used only where the demuxer can seek by
+    // byte (MPEG-TS); MP4 is seeked by the keyframe's dts, and only once the
+    // recording has been finished.
+    bool extractClip(const std::string &input, double startSeconds, double endSeconds, const std::string &output);
+}
+#endif // CLIP_EXTRACTOR_H
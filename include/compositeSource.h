@@ -0,0 +1,53 @@
+#ifndef COMPOSITE_SOURCE_H
+#define COMPOSITE_SOURCE_H
+
+#include <X11/Xlib.h>
+#include <memory>
+#include "frameSource.h"
+
+namespace screen_recorder
+{
+    // Captures a window from the offscreen pixmap the Composite extension
+    // renders it into, so overlapping windows and parts moved off-screen
+    // never end up in the frame. The pixmap is grabbed through MIT-SHM when
+    // available and only named again when the window changes size. Frames
+    // keep the size the window had at the start: a grown window is cropped,
+    // a shrunk one padded with black. With an x, y origin only that part of
+    // the window is read.
+    class CompositeSource : public FrameSource
+    {
+    public:
+        CompositeSource(Display *display, Window window, int x, int y, int width, int height);
+        ~CompositeSource() override;
+        CompositeSource(const CompositeSource &) = delete;
+        CompositeSource &operator=(const CompositeSource &) = delete;
+
+        static bool isSupported(Display *display);
+        // False if the window could not be redirected or has no pixmap yet
+        bool isValid() const { return mSource != nullptr; }
+        int width() const override { return mWidth; }
+        int height() const override { return mHeight; }
+        const char *name() const override { return "composite"; }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        bool acquirePixmap();
+        void releasePixmap();
+        void checkResize();
+
+        Display *mDisplay;
+        Window mWindow;
+        int mX;
+        int mY;
+        int mWidth;
+        int mHeight;
+        Visual *mVisual;
+        int mDepth;
+        bool mRedirected;
+        Pixmap mPixmap;
+        int mPixmapWidth;
+        int mPixmapHeight;
+        std::unique_ptr<FrameSource> mSource; // grabs from mPixmap
+    };
+}
+#endif // COMPOSITE_SOURCE_H
@@ -2,12 +2,21 @@
 #define SCREEN_RECORDER_H
 #include <iostream>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include "libyuv/video_common.h"
 #include "libyuv/convert.h"
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <memory>
 #include <vector>
+#include "frame.h"
+#include "frameRing.h"
+#include "frameSource.h"
+#include "packetSink.h"
+
+struct AVFrame;
 
 struct DisplayDeleter
 {
@@ -33,23 +42,122 @@ struct ImageDeleter
 
 namespace screen_recorder
 {
+    // How long the last recording took to get going, counted from the
+    // startCapture/startCaptureAsync call (window lookup included); -1 until
+    // it happened
+    struct StartupTiming
+    {
+        double firstFrameMs = -1;  // first frame grabbed
+        double firstPacketMs = -1; // first packet out of the encoder
+    };
+
     class DesktopCapture
     {
     private:
         std::thread mCaptureThread;
+        std::atomic<bool> mStopRequested{false};
+        std::atomic<bool> mCapturing{false};
+        std::atomic<bool> mAdaptiveQuality{false};
+        std::atomic<int> mConversionSlices{0};
+        std::atomic<bool> mCompositeCapture{false};
+        std::atomic<int> mTimeLapseFps{0};
+        std::atomic<int> mOutputWidth{0};
+        std::atomic<int> mOutputHeight{0};
+        std::mutex mCallbackMutex;
+        FrameCallback mFrameCallback;
+        PixelFormat mFrameCallbackFormat = PixelFormat::BGRX;
+        std::shared_ptr<FrameRingWriter> mFrameRing;
+        PacketCallback mPacketCallback;
+        std::vector<std::shared_ptr<PacketSink>> mPacketSinks;
+        CaptureRegion mCrop;
+        std::string mTracePath;
+        std::atomic<double> mFirstFrameMs{-1};
+        std::atomic<double> mFirstPacketMs{-1};
+        std::atomic<int> mCaptureFps{0};
         std::unique_ptr<Display, DisplayDeleter> mDisplay;
         Window mRootWindow;
         int mScreenWidth;
         int mScreenHeight;
         XWindowAttributes mWindowAttributes;
-        std::vector<Window> mCapturableWindows;
+        mutable std::mutex mWindowsMutex;
+        mutable std::vector<Window> mCapturableWindows;
+        mutable bool mWindowsListed;
+
+        std::unique_ptr<FrameSource> createWindowSource(Window windowId);
+        // requestedAt: when the start was asked for, the origin of StartupTiming
+        bool launchCapture(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds,
+                           std::chrono::steady_clock::time_point requestedAt);
+        void captureFrom(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds,
+                         std::chrono::steady_clock::time_point requestedAt);
+        void runCapture(FrameSource &source, const std::string &filename, int fps, int duration_seconds,
+                        std::chrono::steady_clock::time_point requestedAt);
+        bool wantsFrames(PixelFormat format);
+        void deliverFrame(const std::shared_ptr<const Frame> &frame);
+        void publishFrame(const AVFrame *converted, uint64_t index);
+        void publishPacket(const AVPacket *packet, int timeBaseNum, int timeBaseDen);
 
     public:
-        DesktopCapture();
+        // Throws std::runtime_error if the X display cannot be opened. Without a
+        // display only synthetic and replay sources can be recorded.
+        explicit DesktopCapture(bool connectDisplay = true);
         ~DesktopCapture();
+        // Walks the window tree on first use
+        const std::vector<Window> &getCapturableWindows() const;
+        void printWindowInfo();
+        // Callbacks run on the capture thread without any lock held and may
+        // call the setters. One already in flight still completes after it
+        // has been replaced.
+        void setFrameCallback(FrameCallback callback, PixelFormat format = PixelFormat::BGRX);
+        // Publishes every captured frame into a shared-memory ring for other processes
+        void setFrameRing(std::shared_ptr<FrameRingWriter> ring);
+        void setPacketCallback(PacketCallback callback);
+        // Extra destinations for the encoded stream besides the output file,
+        // each fed from its own thread. Takes effect on the next start.
+        void addPacketSink(std::shared_ptr<PacketSink> sink);
+        void clearPacketSinks();
+        // Lets live recordings trade encoder preset and capture rate for
+        // keeping up when the host is loaded. Takes effect on the next start.
+        void setAdaptiveQuality(bool enabled);
+        // Threads used for colour conversion, <= 0 picks from the core count
+        // and frame size. Takes effect on the next start.
+        void setConversionSlices(int slices);
+        // When enabled (off by default), windows are grabbed from their
+        // Composite pixmap if the server supports it, unaffected by
+        // overlapping windows.
+        void setCompositeCapture(bool enabled);
+        // Time-lapse mode for long live recordings: sample at `idleFps` while
+        // nothing happens, at the full rate while the content changes or the
+        // pointer or keyboard is used, and only encode frames that differ.
+        // Frames keep their wall-clock timestamps. 0 disables it. Takes
+        // effect on the next start.
+        void setTimeLapse(int idleFps);
+        // Records only this part of the window, read straight from the server
+        // so the rest is never transferred. Clipped to the window; an empty
+        // region records all of it. Takes effect on the next start.
+        void setCrop(const CaptureRegion &region);
+        // Encodes at this size instead of the captured one. Scaling is done
+        // in the same pass as the YUV conversion. A 0 dimension follows the
+        // aspect ratio, 0x0 keeps the captured size. Takes effect on the next start.
+        void setOutputSize(int width, int height);
+        // Records a per-frame timeline of every pipeline thread and writes it
+        // to `path` as Chrome trace JSON when the recording ends. An empty
+        // path disables it. Takes effect on the next start.
+        void setTracePath(const std::string &path);
+        StartupTiming getStartupTiming() const;
+        // Nominal rate of the current or last recording, resolved from the
+        // source when started with fps <= 0; 0 before any start. Set before
+        // the first frame reaches the callbacks.
+        int getCaptureFps() const;
+        bool isCapturing() const;
         void captureThumbnail(Window windowId, const std::string &filename);
         void stopCapture();
+        // duration_seconds <= 0 records until stopCapture(); an empty filename
+        // skips the MP4 output and only feeds the callbacks.
         void startCapture(Window windowId, const std::string &filename, int fps, int duration_seconds);
+        // fps <= 0 takes the source's own frame rate
+        void startCapture(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds);
+        bool startCaptureAsync(Window windowId, const std::string &filename, int fps, int duration_seconds);
+        bool startCaptureAsync(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds);
     };
 }
-#endif
\ No newline at end of file
+#endif
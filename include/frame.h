@@ -0,0 +1,39 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+struct AVPacket;
+
+namespace screen_recorder
+{
+    enum class PixelFormat
+    {
+        BGRX, // 32-bit packed, single plane, X byte ignored
+        I420  // 8-bit planar YUV 4:2:0, three planes
+    };
+
+    // A captured frame. The planes point straight into the capture buffer
+    // (e.g. the XImage) which is kept alive by `owner`, so holding on to the
+    // shared_ptr is all a consumer needs to do to keep the pixels valid.
+    struct Frame
+    {
+        int width = 0;
+        int height = 0;
+        PixelFormat format = PixelFormat::BGRX;
+        const uint8_t *data[3] = {nullptr, nullptr, nullptr};
+        int stride[3] = {0, 0, 0};
+        int64_t timestampUs = 0; // steady clock, microseconds
+        uint64_t index = 0;
+        std::shared_ptr<const void> owner;
+    };
+
+    using FrameCallback = std::function<void(const std::shared_ptr<const Frame> &frame)>;
+
+    // Called for every encoded packet with timestamps in the stream time base.
+    // The packet is only borrowed; use av_packet_ref/av_packet_clone to keep it.
+    using PacketCallback = std::function<void(const AVPacket *packet, int timeBaseNum, int timeBaseDen)>;
+}
+#endif // FRAME_H
@@ -0,0 +1,109 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "frame.h"
+
+namespace screen_recorder
+{
+    // Layout of the POSIX shared-memory object (shm_open name, /dev/shm/<name>):
+    //
+    //   FrameRingHeader | FrameRingSlot[slotCount] | pad to page | payload[slotCount]
+    //
+    // The single producer never waits for consumers. Every slot is guarded by
+    // a sequence lock: `sequence` is odd while the slot is being rewritten and
+    // 2 * n once frame n is complete. Readers look up the newest frame through
+    // `writeSequence`, use the pixels in place and re-check the slot sequence
+    // afterwards to learn whether the producer lapped them meanwhile.
+    constexpr uint32_t kFrameRingMagic = 0x53434652; // "SCFR"
+    constexpr uint32_t kFrameRingVersion = 1;
+
+    struct FrameRingSlot
+    {
+        std::atomic<uint64_t> sequence;
+        uint64_t frameIndex;
+        int64_t timestampUs;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format; // PixelFormat
+        uint32_t stride[3];
+        uint32_t offset[3]; // plane offsets from the start of the slot payload
+    };
+
+    struct FrameRingHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t reserved;
+        uint64_t slotSize;      // payload bytes per slot
+        uint64_t payloadOffset; // from the start of the mapping
+        std::atomic<uint64_t> writeSequence; // last completed frame, 0 = none yet
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "frame ring needs lock-free 64-bit atomics to be shared between processes");
+
+    // Producer side, fed from the capture loop. The name is claimed when the
+    // writer is constructed and fails if another writer holds it; the ring is
+    // sized for the first published frame. Smaller frames still fit, a larger
+    // one ends the export since readers cannot follow a resize.
+    class FrameRingWriter
+    {
+    public:
+        FrameRingWriter(const std::string &name, PixelFormat format, int slotCount);
+        ~FrameRingWriter();
+        FrameRingWriter(const FrameRingWriter &) = delete;
+        FrameRingWriter &operator=(const FrameRingWriter &) = delete;
+
+        // False if the name could not be claimed or the export has ended
+        bool isOpen() const { return !mEnded; }
+        PixelFormat format() const { return mFormat; }
+        bool publish(const Frame &frame);
+        void close();
+
+    private:
+        bool create(int width, int height);
+
+        std::string mName;
+        PixelFormat mFormat;
+        int mSlotCount;
+        int mFd;
+        uint8_t *mMapping;
+        size_t mMappingSize;
+        uint64_t mSequence;
+        bool mEnded;
+    };
+
+    // A frame borrowed from the ring. The pointers stay readable until the ring
+    // is closed, but the content is only trustworthy while isValid() holds.
+    struct FrameRingView
+    {
+        uint64_t sequence = 0;
+        Frame frame;
+    };
+
+    class FrameRingReader
+    {
+    public:
+        FrameRingReader();
+        ~FrameRingReader();
+        FrameRingReader(const FrameRingReader &) = delete;
+        FrameRingReader &operator=(const FrameRingReader &) = delete;
+
+        bool open(const std::string &name);
+        void close();
+        // Fills `view` with the newest complete frame newer than `afterSequence`.
+        bool acquireLatest(FrameRingView &view, uint64_t afterSequence = 0) const;
+        bool isValid(const FrameRingView &view) const;
+
+    private:
+        int mFd;
+        uint8_t *mMapping;
+        size_t mMappingSize;
+    };
+}
+#endif // FRAME_RING_H
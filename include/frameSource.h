@@ -0,0 +1,144 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "frame.h"
+#include "pixelUnpack.h"
+
+namespace screen_recorder
+{
+    // Where the capture loop gets its pixels from. Every source hands out BGRX
+    // frames of a fixed size; the frame owns (or shares) its backing memory.
+    class FrameSource
+    {
+    public:
+        virtual ~FrameSource() = default;
+
+        virtual int width() const = 0;
+        virtual int height() const = 0;
+        // Nominal rate of a generated or recorded stream, 0 for live sources
+        virtual int frameRate() const { return 0; }
+        // Live sources are paced to the wall clock; generated and replayed
+        // ones run as fast as the pipeline can consume them unless asked not to.
+        virtual bool isRealtime() const { return true; }
+        virtual const char *name() const = 0;
+        // True once a finite source has nothing more to hand out
+        virtual bool atEnd() const { return false; }
+        // Returns nullptr if no frame could be produced this time
+        virtual std::shared_ptr<const Frame> grab(uint64_t index) = 0;
+    };
+
+    // Part of a drawable or frame to capture; an empty region means all of it
+    struct CaptureRegion
+    {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+
+        bool isEmpty() const { return width <= 0 || height <= 0; }
+    };
+
+    // Plain XGetImage round trip, one freshly allocated image per frame.
+    // Only the width x height area at x, y of the drawable is transferred.
+    // Images of a pixmap carry no colour masks, so pixmaps need the visual
+    // and depth of the window they belong to.
+    class XGetImageSource : public FrameSource
+    {
+    public:
+        XGetImageSource(Display *display, Drawable drawable, int x, int y, int width, int height,
+                        Visual *visual = nullptr, int depth = 0);
+
+        int width() const override { return mWidth; }
+        int height() const override { return mHeight; }
+        const char *name() const override { return "xgetimage"; }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        Display *mDisplay;
+        Drawable mDrawable;
+        int mX;
+        int mY;
+        int mWidth;
+        int mHeight;
+        Visual *mVisual;
+        int mDepth;
+        pixel_unpack::Unpacker mUnpacker;
+        bool mUnpackerSelected;
+    };
+
+    // MIT-SHM capture: the server writes straight into shared segments that
+    // are recycled once no frame references them any more.
+    class XShmSource : public FrameSource
+    {
+    public:
+        // Without a visual the drawable must be a window and its own is used
+        XShmSource(Display *display, Drawable drawable, int x, int y, int width, int height,
+                   Visual *visual = nullptr, int depth = 0);
+        ~XShmSource() override;
+
+        static bool isSupported(Display *display);
+        int width() const override { return mWidth; }
+        int height() const override { return mHeight; }
+        const char *name() const override { return "xshm"; }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        struct Segment;
+        std::shared_ptr<Segment> acquireSegment();
+
+        Display *mDisplay;
+        Drawable mDrawable;
+        int mX;
+        int mY;
+        int mWidth;
+        int mHeight;
+        Visual *mVisual;
+        int mDepth;
+        pixel_unpack::Unpacker mUnpacker;
+        std::vector<std::shared_ptr<Segment>> mSegments;
+        bool mShmFailed = false;
+        XGetImageSource mFallback;
+    };
+
+    // Picks XShm when the server supports it, XGetImage otherwise. Pixmaps
+    // need the visual and depth of the window they belong to.
+    std::unique_ptr<FrameSource> createXSource(Display *display, Drawable drawable, int x, int y, int width, int height,
+                                               Visual *visual = nullptr, int depth = 0);
+
+    // Zero-copy view of a region of another source's frames, for sources
+    // that cannot crop while grabbing. The region is clipped to the source.
+    class CroppedSource : public FrameSource
+    {
+    public:
+        CroppedSource(std::unique_ptr<FrameSource> source, const CaptureRegion &region);
+
+        int width() const override { return mRegion.width; }
+        int height() const override { return mRegion.height; }
+        int frameRate() const override { return mSource->frameRate(); }
+        bool isRealtime() const override { return mSource->isRealtime(); }
+        const char *name() const override { return mSource->name(); }
+        bool atEnd() const override { return mSource->atEnd(); }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        std::unique_ptr<FrameSource> mSource;
+        CaptureRegion mRegion;
+    };
+
+    // Display-free sources from a command line spec,
+    // synthetic:<pattern>:<W>x<H>[@fps] or replay:<file>
+    std::unique_ptr<FrameSource> createSourceFromSpec(const std::string &spec, int fps);
+
+    // Wraps an XImage as a BGRX frame, zero copy when the unpacker says the
+    // image already is BGRX and through the unpacker otherwise
+    std::shared_ptr<const Frame> frameFromXImage(const std::shared_ptr<XImage> &image, const pixel_unpack::Unpacker &unpacker,
+                                                 int width, int height, uint64_t index);
+
+    int64_t steadyClockMicros();
+}
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,59 @@
+#ifndef FRAME_TRACER_H
+#define FRAME_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace screen_recorder
+{
+    // Opt-in timeline of which thread spent how long on which frame. Every
+    // thread appends to its own buffer without taking a lock; only the first
+    // event of a thread in a session registers it. stop() writes the Chrome
+    // trace event format, which chrome://tracing and ui.perfetto.dev open.
+    // While stopped a span costs one relaxed atomic load. The tracer is
+    // process-wide: spans are not told apart by recording, so only one
+    // session can be open at a time.
+    class FrameTracer
+    {
+    public:
+        // Discards anything recorded before and starts a new session; false
+        // while another session is still open
+        static bool start();
+        // Stops the open session and writes it to `path` as JSON
+        static bool stop(const std::string &path);
+        static bool isEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+        // Label for the calling thread's track; kept across sessions
+        static void setThreadName(const std::string &name);
+        // `name` must outlive the session (a string literal); frame < 0 for
+        // work that belongs to no particular frame
+        static void record(const char *name, int64_t frame, int64_t beginNs, int64_t endNs);
+        static int64_t nowNs();
+
+    private:
+        static std::atomic<bool> sEnabled;
+    };
+
+    // Records the scope it lives in as one span of the calling thread
+    class TraceSpan
+    {
+    public:
+        TraceSpan(const char *name, int64_t frame = -1)
+            : mName(name), mFrame(frame), mBeginNs(FrameTracer::isEnabled() ? FrameTracer::nowNs() : -1)
+        {
+        }
+        ~TraceSpan()
+        {
+            if (mBeginNs >= 0)
+                FrameTracer::record(mName, mFrame, mBeginNs, FrameTracer::nowNs());
+        }
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+    private:
+        const char *mName;
+        int64_t mFrame;
+        int64_t mBeginNs;
+    };
+}
+#endif // FRAME_TRACER_H
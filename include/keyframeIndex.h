@@ -0,0 +1,67 @@
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace screen_recorder
+{
+    // Keyframe index sidecar: KeyframeIndexHeader followed by one
+    // KeyframeIndexEntry per keyframe, in the order they were muxed. Entries
+    // are flushed as they are written, so the index of an interrupted
+    // recording is still usable up to the last keyframe on disk.
+    constexpr char kKeyframeIndexMagic[8] = {'S', 'C', 'K', 'I', 'D', 'X', '0', '1'};
+
+    struct KeyframeIndexHeader
+    {
+        char magic[8];
+        int32_t timeBaseNum; // of pts/dts below, the output stream's time base
+        int32_t timeBaseDen;
+    };
+
+    struct KeyframeIndexEntry
+    {
+        int64_t pts;
+        int64_t dts;
+        int64_t byteOffset; // where the muxer started writing the packet
+        uint32_t segment;   // output file number, 0 while recordings are a single file
+        uint32_t reserved;
+    };
+
+    // Sidecar path for a recording, "<recording>.idx"
+    std::string keyframeIndexPath(const std::string &recordingPath);
+
+    class KeyframeIndexWriter
+    {
+    public:
+        KeyframeIndexWriter();
+        ~KeyframeIndexWriter();
+        KeyframeIndexWriter(const KeyframeIndexWriter &) = delete;
+        KeyframeIndexWriter &operator=(const KeyframeIndexWriter &) = delete;
+
+        bool open(const std::string &path, int timeBaseNum, int timeBaseDen);
+        bool isOpen() const { return mFile != nullptr; }
+        bool append(int64_t pts, int64_t dts, int64_t byteOffset, uint32_t segment = 0);
+        void close();
+
+    private:
+        FILE *mFile;
+    };
+
+    class KeyframeIndex
+    {
+    public:
+        bool load(const std::string &path);
+        const KeyframeIndexHeader &header() const { return mHeader; }
+        const std::vector<KeyframeIndexEntry> &entries() const { return mEntries; }
+        // Last keyframe at or before pts, or nullptr if pts precedes them all
+        const KeyframeIndexEntry *findAtOrBefore(int64_t pts) const;
+
+    private:
+        KeyframeIndexHeader mHeader{};
+        std::vector<KeyframeIndexEntry> mEntries; // sorted by pts
+    };
+}
+#endif // KEYFRAME_INDEX_H
@@ -0,0 +1,51 @@
+#ifndef LOAD_CONTROLLER_H
+#define LOAD_CONTROLLER_H
+
+#include <cstddef>
+
+namespace screen_recorder
+{
+    // Measured cost of one captured frame, in milliseconds
+    struct FrameTiming
+    {
+        double grabMs = 0;
+        double convertMs = 0;
+        double encodeMs = 0;
+        int lateFrames = 0; // capture ticks already overdue when this frame started
+    };
+
+    // Feedback controller for paced recordings. It keeps a smoothed average of
+    // the per-frame work against the frame budget and walks a ladder of
+    // cheaper encoder presets, then lower capture rates, when the pipeline
+    // falls behind; with lasting headroom it climbs back up. Every step is
+    // logged so a degraded recording can be explained afterwards.
+    class LoadController
+    {
+    public:
+        struct Level
+        {
+            const char *preset;
+            int fpsDivisor; // capture every n-th tick of the output rate
+        };
+
+        explicit LoadController(int fps);
+
+        // Returns true when the level changed with this frame
+        bool update(const FrameTiming &timing);
+        const Level &level() const;
+        size_t levelIndex() const { return mLevel; }
+
+    private:
+        double budgetMs(size_t level) const;
+        void changeLevel(size_t level, const char *reason, double load);
+
+        int mFps;
+        size_t mLevel;
+        double mBusyMs;  // exponentially weighted frame cost
+        bool mPrimed;
+        int mOverloadedFrames;
+        int mIdleFrames;
+        int mCooldownFrames;
+    };
+}
+#endif // LOAD_CONTROLLER_H
@@ -0,0 +1,71 @@
+#ifndef PACKET_FANOUT_H
+#define PACKET_FANOUT_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "packetSink.h"
+
+namespace screen_recorder
+{
+    // Hands every encoded packet to any number of sinks. A packet is
+    // referenced once and shared; each sink has its own thread and a bounded
+    // queue. When the queue of a live sink is full, that sink drops packets up
+    // to the next keyframe so it stays decodable. A lossless sink (the
+    // recording itself) gets a much deeper queue, and only when even that is
+    // full does push() wait for it. A sink whose open or write fails is
+    // dropped; the others carry on.
+    class PacketFanout
+    {
+    public:
+        explicit PacketFanout(size_t queueCapacity = 256);
+        ~PacketFanout();
+        PacketFanout(const PacketFanout &) = delete;
+        PacketFanout &operator=(const PacketFanout &) = delete;
+
+        void addSink(std::shared_ptr<PacketSink> sink, bool lossless = false);
+        bool empty() const { return mChannels.empty(); }
+        // Opens every sink on its thread with the encoder's stream parameters
+        void start(const AVCodecContext *codecContext);
+        // Packet timestamps are in the codec time base
+        void push(const AVPacket *packet);
+        // Lets each sink finish its queue and close. Sinks that are stuck
+        // after `timeoutMs` get aborted; one that still does not return (a
+        // write blocked in the kernel) is left to finish on its own thread.
+        void stop(int timeoutMs = 5000);
+
+    private:
+        // Owned jointly with the sink's thread, which may outlive the fanout
+        struct Channel
+        {
+            ~Channel() { avcodec_parameters_free(&parameters); }
+
+            std::shared_ptr<PacketSink> sink;
+            bool lossless = false;
+            AVCodecParameters *parameters = nullptr;
+            AVRational timeBase{1, 1};
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::condition_variable space; // lossless sinks only
+            std::condition_variable finished;
+            std::deque<std::shared_ptr<const AVPacket>> queue;
+            bool waitForKeyframe = false;
+            bool stalled = false;
+            bool failed = false;
+            bool closing = false;
+            bool done = false;
+            uint64_t written = 0;
+            uint64_t dropped = 0;
+        };
+
+        static void run(Channel &channel);
+
+        size_t mQueueCapacity;
+        std::vector<std::shared_ptr<Channel>> mChannels;
+    };
+}
+#endif // PACKET_FANOUT_H
@@ -0,0 +1,89 @@
+#ifndef PACKET_SINK_H
+#define PACKET_SINK_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "keyframeIndex.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+namespace screen_recorder
+{
+    // Destination for the encoded stream. PacketFanout drives each sink from
+    // its own thread, so a sink may block without holding up the encoder.
+    class PacketSink
+    {
+    public:
+        virtual ~PacketSink() = default;
+
+        virtual std::string name() const = 0;
+        // Called before the first packet; timeBase is the one of the packets
+        virtual bool open(const AVCodecParameters *parameters, AVRational timeBase) = 0;
+        // Packets are shared between all sinks and must not be modified
+        virtual bool write(const std::shared_ptr<const AVPacket> &packet) = 0;
+        virtual void close() = 0;
+        // Called from another thread to break out of a blocked write
+        virtual void abort() {}
+    };
+
+    // Muxes into a file or any URL libavformat can write to (tcp://, udp://,
+    // ...). The container is guessed from the URL, MPEG-TS for streams
+    // without an extension, unless formatName is given.
+    class MuxerSink : public PacketSink
+    {
+    public:
+        MuxerSink(const std::string &url, const std::string &formatName = "", bool writeKeyframeIndex = false);
+        ~MuxerSink() override;
+
+        std::string name() const override { return mUrl; }
+        bool open(const AVCodecParameters *parameters, AVRational timeBase) override;
+        bool write(const std::shared_ptr<const AVPacket> &packet) override;
+        void close() override;
+        void abort() override;
+
+    private:
+        static int interrupted(void *opaque);
+
+        std::string mUrl;
+        std::string mFormatName;
+        bool mWriteKeyframeIndex;
+        AVFormatContext *mFormatContext;
+        AVPacket *mPacket;
+        AVRational mTimeBase;
+        bool mHeaderWritten;
+        std::atomic<bool> mAborted{false};
+        KeyframeIndexWriter mKeyframeIndex;
+    };
+
+    // Keeps the most recent packets in memory, trimmed a whole GOP at a time
+    // so the buffer always starts on a keyframe. Useful as a replay buffer.
+    class MemorySink : public PacketSink
+    {
+    public:
+        explicit MemorySink(size_t maxBytes);
+
+        std::string name() const override { return "memory"; }
+        bool open(const AVCodecParameters *parameters, AVRational timeBase) override;
+        bool write(const std::shared_ptr<const AVPacket> &packet) override;
+        void close() override {}
+
+        AVRational timeBase() const;
+        std::vector<std::shared_ptr<const AVPacket>> snapshot() const;
+
+    private:
+        size_t mMaxBytes;
+        mutable std::mutex mMutex;
+        std::deque<std::shared_ptr<const AVPacket>> mPackets;
+        size_t mBytes;
+        AVRational mTimeBase;
+    };
+}
+#endif // PACKET_SINK_H
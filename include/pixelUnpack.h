@@ -0,0 +1,27 @@
+#ifndef PIXEL_UNPACK_H
+#define PIXEL_UNPACK_H
+
+#include <X11/Xlib.h>
+#include <cstdint>
+
+namespace pixel_unpack
+{
+    // Converts `height` rows of an X image into BGRX. The X byte is unspecified.
+    using UnpackFunction = void (*)(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height);
+
+    struct Unpacker
+    {
+        UnpackFunction unpack = nullptr; // nullptr: no fast path, use genericUnpack
+        bool native = false;             // already BGRX in memory, no conversion needed
+        const char *name = "generic";
+    };
+
+    // Picks the specialized unpacker for an image's bits per pixel, channel
+    // masks and byte order. Done once per session, the layout never changes
+    // for a given drawable.
+    Unpacker selectUnpacker(const XImage *image);
+
+    // Fallback for exotic visuals (indexed color, odd masks) through XGetPixel
+    void genericUnpack(XImage *image, uint8_t *dst, int dstStride, int width, int height);
+}
+#endif // PIXEL_UNPACK_H
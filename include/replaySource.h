@@ -0,0 +1,70 @@
+#ifndef REPLAY_SOURCE_H
+#define REPLAY_SOURCE_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "frameSource.h"
+
+namespace screen_recorder
+{
+    // Raw frame file: RawFrameFileHeader followed by frameCount frames of
+    // stride * height BGRX bytes each, every frame starting on a 4 KiB boundary.
+    constexpr char kRawFrameMagic[8] = {'S', 'C', 'R', 'A', 'W', '0', '0', '1'};
+
+    struct RawFrameFileHeader
+    {
+        char magic[8];
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint32_t fps;
+        uint64_t frameSize; // bytes between consecutive frames
+        uint64_t dataOffset;
+    };
+
+    // Dumps captured frames so a session can be replayed later
+    class RawFrameWriter
+    {
+    public:
+        RawFrameWriter();
+        ~RawFrameWriter();
+        RawFrameWriter(const RawFrameWriter &) = delete;
+        RawFrameWriter &operator=(const RawFrameWriter &) = delete;
+
+        bool open(const std::string &path, int width, int height, int fps);
+        bool write(const Frame &frame);
+        void close();
+
+    private:
+        FILE *mFile;
+        RawFrameFileHeader mHeader;
+    };
+
+    // Serves frames straight out of a memory-mapped raw frame file
+    class ReplaySource : public FrameSource
+    {
+    public:
+        ReplaySource(const std::string &path, bool loop = true, bool realtime = false);
+        ~ReplaySource() override;
+
+        bool isOpen() const { return mMapping != nullptr; }
+        uint64_t frameCount() const { return mFrameCount; }
+        int width() const override { return mHeader.width; }
+        int height() const override { return mHeader.height; }
+        int frameRate() const override { return mHeader.fps; }
+        bool isRealtime() const override { return mRealtime; }
+        const char *name() const override { return "replay"; }
+        bool atEnd() const override { return mAtEnd; }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        RawFrameFileHeader mHeader;
+        std::shared_ptr<const uint8_t> mMapping;
+        uint64_t mFrameCount;
+        bool mLoop;
+        bool mRealtime;
+        bool mAtEnd;
+    };
+}
+#endif // REPLAY_SOURCE_H
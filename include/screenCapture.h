@@ -0,0 +1,208 @@
+#ifndef SCREEN_CAPTURE_H
+#define SCREEN_CAPTURE_H
+
+/*
+ * C API of libscreencapture.
+ *
+ * A session owns one X display connection. Frames and packets are delivered
+ * on the capture thread through the registered callbacks; both are borrowed
+ * for the duration of the callback and can be retained without copying the
+ * pixels or bitstream via sc_frame_ref / sc_packet_ref.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* SC_BUILDING_LIBRARY is defined while building the shared library,
+ * SC_STATIC for the static one; the CMake target sets whichever applies. */
+#if defined(SC_STATIC)
+#define SC_API
+#elif defined(_WIN32) && defined(SC_BUILDING_LIBRARY)
+#define SC_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define SC_API __declspec(dllimport)
+#else
+#define SC_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    enum
+    {
+        SC_OK = 0,
+        SC_ERROR = -1,
+        SC_ERROR_INVALID_ARGUMENT = -2,
+        SC_ERROR_BUSY = -3
+    };
+
+    typedef enum sc_pixel_format
+    {
+        SC_PIXEL_FORMAT_BGRX = 0,
+        SC_PIXEL_FORMAT_I420 = 1
+    } sc_pixel_format;
+
+    typedef struct sc_session sc_session;
+    typedef struct sc_frame sc_frame;
+    typedef struct sc_packet sc_packet;
+    typedef struct sc_frame_ring sc_frame_ring;
+    typedef struct sc_memory_output sc_memory_output;
+
+    typedef struct sc_window_info
+    {
+        unsigned long id;
+        int x;
+        int y;
+        int width;
+        int height;
+        char name[256];
+    } sc_window_info;
+
+    typedef struct sc_frame_info
+    {
+        int width;
+        int height;
+        sc_pixel_format format;
+        const uint8_t *data[3];
+        int stride[3];
+        int64_t timestamp_us;
+        uint64_t index;
+    } sc_frame_info;
+
+    typedef struct sc_packet_info
+    {
+        const uint8_t *data;
+        int size;
+        int64_t pts;
+        int64_t dts;
+        int keyframe;
+        int time_base_num;
+        int time_base_den;
+    } sc_packet_info;
+
+    typedef void (*sc_frame_callback)(const sc_frame *frame, void *user_data);
+    typedef void (*sc_packet_callback)(const sc_packet *packet, void *user_data);
+
+    /* Returns NULL if the display cannot be opened. */
+    SC_API sc_session *sc_session_open(void);
+    /* A session without an X connection, for synthetic and replay sources only. */
+    SC_API sc_session *sc_session_open_headless(void);
+    SC_API void sc_session_close(sc_session *session);
+
+    /* Fills up to `capacity` entries and returns the total number of capturable windows. */
+    SC_API int sc_session_list_windows(sc_session *session, sc_window_info *windows, int capacity);
+
+    /* Frames are delivered as captured (BGRX). */
+    SC_API int sc_session_set_frame_callback(sc_session *session, sc_frame_callback callback, void *user_data);
+    /* Same, but with SC_PIXEL_FORMAT_I420 frames as fed to the encoder. */
+    SC_API int sc_session_set_frame_callback_format(sc_session *session, sc_pixel_format format, sc_frame_callback callback, void *user_data);
+    SC_API int sc_session_set_packet_callback(sc_session *session, sc_packet_callback callback, void *user_data);
+
+    /* Also sends the encoded stream to `url` (a file, or tcp://, udp://, ...
+     * in MPEG-TS unless the extension says otherwise). Every output has its
+     * own thread and queue; one that falls behind or fails loses packets
+     * without holding up the recording or the other outputs. */
+    SC_API int sc_session_add_output(sc_session *session, const char *url);
+    SC_API int sc_session_clear_outputs(sc_session *session);
+    /* Also keeps the most recent `max_bytes` of the stream in memory, whole
+     * GOPs at a time so it always starts on a keyframe (a replay buffer).
+     * Returns NULL on failure. The handle stays valid after the recording
+     * ends and sc_session_clear_outputs; release it with
+     * sc_memory_output_release. */
+    SC_API sc_memory_output *sc_session_add_memory_output(sc_session *session, size_t max_bytes);
+    /* Stores references to up to `capacity` of the buffered packets, oldest
+     * first, in `packets` and returns how many are buffered in total. Each
+     * stored packet must be released with sc_packet_unref. */
+    SC_API int sc_memory_output_snapshot(const sc_memory_output *output, sc_packet **packets, int capacity);
+    SC_API void sc_memory_output_release(sc_memory_output *output);
+
+    /* Publishes every frame into the POSIX shared-memory ring `name` (see
+     * frameRing.h for the layout) so other processes can read it without
+     * copying. A NULL name stops the export. */
+    SC_API int sc_session_export_frames(sc_session *session, const char *name, sc_pixel_format format, int slot_count);
+
+    /* With `enabled` non-zero, live recordings step the encoder preset and
+     * then the capture rate down while the host cannot keep up, and back up
+     * once it can. Applies from the next start. */
+    SC_API int sc_session_set_adaptive(sc_session *session, int enabled);
+    /* Number of threads converting each frame to YUV; <= 0 (the default)
+     * picks one from the core count and frame size. Applies from the next
+     * start. */
+    SC_API int sc_session_set_conversion_slices(sc_session *session, int slices);
+    /* With `enabled` non-zero, window recordings read the window's Composite
+     * pixmap when the server supports it, so overlapping windows don't show.
+     * Off by default: the on-screen pixels are grabbed as before. Applies
+     * from the next start. */
+    SC_API int sc_session_set_composite(sc_session *session, int enabled);
+    /* Time-lapse mode for long recordings: with `idle_fps` > 0 live captures
+     * sample at that rate until the content changes or input is seen, then
+     * at the full rate until things are quiet again. Unchanged frames are not
+     * encoded; timestamps stay real. 0 (the default) disables it. Applies
+     * from the next start. */
+    SC_API int sc_session_set_timelapse(sc_session *session, int idle_fps);
+    /* Records only the width x height area at x, y of the window, clipped to
+     * it. The rest is never read from the X server. A zero width or height
+     * records the whole window. Applies from the next start. */
+    SC_API int sc_session_set_crop(sc_session *session, int x, int y, int width, int height);
+    /* Encodes at width x height, scaled during the YUV conversion. A zero
+     * dimension keeps the aspect ratio; 0x0 (the default) keeps the captured
+     * size. Applies from the next start. */
+    SC_API int sc_session_set_output_size(sc_session *session, int width, int height);
+    /* Records a timeline of every frame's grab, convert, encode and write
+     * steps on all threads and writes it to `path` as Chrome trace JSON when
+     * the recording ends (open it in ui.perfetto.dev). NULL or empty turns it
+     * off. Applies from the next start. Tracing is process-wide: while one
+     * session is traced, others in the same process record without a trace. */
+    SC_API int sc_session_set_trace(sc_session *session, const char *path);
+
+    /* Starts recording on a background thread. `filename` may be NULL or empty
+     * to skip file output; `duration_seconds` <= 0 records until stopped.
+     * Returns SC_ERROR_BUSY while a recording is running and
+     * SC_ERROR_INVALID_ARGUMENT for a window that cannot be captured. */
+    SC_API int sc_session_start(sc_session *session, unsigned long window, const char *filename, int fps, int duration_seconds);
+    /* Same as sc_session_start but recording generated content ("text",
+     * "noise" or "static") or a raw frame file written by --dump-raw. These
+     * run as fast as the encoder allows, which makes them suitable for load
+     * tests. Generated content needs fps > 0; for a replay fps <= 0 uses the
+     * file's own rate. Both return SC_ERROR_BUSY while a recording is
+     * running and SC_ERROR when the source cannot be read. */
+    SC_API int sc_session_start_synthetic(sc_session *session, const char *pattern, int width, int height, int fps, const char *filename, int duration_seconds);
+    SC_API int sc_session_start_replay(sc_session *session, const char *path, const char *filename, int fps, int duration_seconds);
+    SC_API int sc_session_stop(sc_session *session);
+    SC_API int sc_session_is_capturing(const sc_session *session);
+    /* Milliseconds from the sc_session_start* call to the first grabbed frame
+     * and to the first encoded packet of the last recording, -1 for what has
+     * not happened yet. Either pointer may be NULL. */
+    SC_API int sc_session_get_startup_timing(const sc_session *session, double *first_frame_ms, double *first_packet_ms);
+
+    SC_API void sc_frame_get_info(const sc_frame *frame, sc_frame_info *info);
+    SC_API sc_frame *sc_frame_ref(const sc_frame *frame);
+    SC_API void sc_frame_unref(sc_frame *frame);
+
+    SC_API void sc_packet_get_info(const sc_packet *packet, sc_packet_info *info);
+    SC_API sc_packet *sc_packet_ref(const sc_packet *packet);
+    SC_API void sc_packet_unref(sc_packet *packet);
+
+    /* Copies [start_seconds, end_seconds) of a finished recording into
+     * `output` without re-encoding, starting from the keyframe at or before
+     * start_seconds. An MP4 recording cannot be opened before its trailer
+     * has been written. */
+    SC_API int sc_clip_extract(const char *input, double start_seconds, double end_seconds, const char *output);
+
+    /* Consumer side of sc_session_export_frames, usable from any process.
+     * sc_frame_ring_acquire_latest returns SC_OK and the newest frame newer
+     * than `after_sequence`; its pixels are read in place and must be
+     * re-checked with sc_frame_ring_is_valid once done, since a slow reader
+     * may be overtaken by the recorder. */
+    SC_API sc_frame_ring *sc_frame_ring_open(const char *name);
+    SC_API void sc_frame_ring_close(sc_frame_ring *ring);
+    SC_API int sc_frame_ring_acquire_latest(sc_frame_ring *ring, uint64_t after_sequence, sc_frame_info *info, uint64_t *sequence);
+    SC_API int sc_frame_ring_is_valid(const sc_frame_ring *ring, uint64_t sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCREEN_CAPTURE_H
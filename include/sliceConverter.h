@@ -0,0 +1,67 @@
+#ifndef SLICE_CONVERTER_H
+#define SLICE_CONVERTER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace screen_recorder
+{
+    // BGRX to YUV420P conversion split into horizontal slices, one per
+    // thread of a pool that lives as long as the converter. Slices start on
+    // even rows so no chroma row is shared between two threads, and each
+    // slice is walked in blocks of rows small enough to stay in cache. When
+    // the output size differs, each block is scaled into its rows of a
+    // shared BGRX frame and converted from there while still in cache.
+    class SliceConverter
+    {
+    public:
+        // sliceCount <= 0 picks one from the core count and frame height
+        SliceConverter(int sliceCount, int height);
+        ~SliceConverter();
+        SliceConverter(const SliceConverter &) = delete;
+        SliceConverter &operator=(const SliceConverter &) = delete;
+
+        int sliceCount() const { return static_cast<int>(mWorkers.size()) + 1; }
+
+        void convert(const uint8_t *src, int srcStride,
+                     uint8_t *const dst[3], const int dstStride[3],
+                     int width, int height);
+        // Scales srcWidth x srcHeight to width x height in the same pass.
+        // `frame` only labels the slices in a trace.
+        void convert(const uint8_t *src, int srcStride, int srcWidth, int srcHeight,
+                     uint8_t *const dst[3], const int dstStride[3],
+                     int width, int height, int64_t frame = -1);
+
+    private:
+        struct Job
+        {
+            const uint8_t *src;
+            int srcStride;
+            int srcWidth;
+            int srcHeight;
+            uint8_t *dst[3];
+            int dstStride[3];
+            int width;
+            int height;
+            int64_t frame;
+        };
+
+        void workerLoop(int slice);
+        void convertSlice(int slice);
+        void scaleSlice(int first, int last);
+
+        std::vector<std::thread> mWorkers; // slice 0 runs on the calling thread
+        std::mutex mMutex;
+        std::condition_variable mWorkReady;
+        std::condition_variable mWorkDone;
+        Job mJob;
+        std::vector<uint8_t> mScaled; // scaled BGRX frame, each slice fills its own rows
+        uint64_t mGeneration;
+        int mPending;
+        bool mShutdown;
+    };
+}
+#endif // SLICE_CONVERTER_H
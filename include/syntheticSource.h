@@ -0,0 +1,45 @@
+#ifndef SYNTHETIC_SOURCE_H
+#define SYNTHETIC_SOURCE_H
+
+#include <vector>
+#include "frameSource.h"
+
+namespace screen_recorder
+{
+    enum class SyntheticPattern
+    {
+        ScrollingText, // terminal/document-like content scrolling up
+        Noise,         // moving gradients plus grain, roughly video content
+        Static         // color bars that never change
+    };
+
+    bool parseSyntheticPattern(const std::string &name, SyntheticPattern &pattern);
+
+    // Deterministic generated content: frame N is always the same image for a
+    // given pattern and geometry, so encode runs can be compared byte for byte.
+    class SyntheticSource : public FrameSource
+    {
+    public:
+        SyntheticSource(SyntheticPattern pattern, int width, int height, int fps, bool realtime = false);
+
+        int width() const override { return mWidth; }
+        int height() const override { return mHeight; }
+        int frameRate() const override { return mFps; }
+        bool isRealtime() const override { return mRealtime; }
+        const char *name() const override { return "synthetic"; }
+        std::shared_ptr<const Frame> grab(uint64_t index) override;
+
+    private:
+        void renderScrollingText(uint8_t *dst, int stride, uint64_t index) const;
+        void renderNoise(uint8_t *dst, int stride, uint64_t index) const;
+        void renderStatic(uint8_t *dst, int stride) const;
+
+        SyntheticPattern mPattern;
+        int mWidth;
+        int mHeight;
+        int mFps;
+        bool mRealtime;
+        std::shared_ptr<std::vector<uint8_t>> mStaticFrame;
+    };
+}
+#endif // SYNTHETIC_SOURCE_H
@@ -5,6 +5,7 @@
 #include <vector>
 #include <cstdint>
 #include <X11/Xlib.h>
+#include "frame.h"
 
 extern "C"
 {
@@ -15,6 +16,21 @@ extern "C"
 }
 namespace video_encoder
 {
+    struct EncoderSettings
+    {
+        int width = 0;
+        int height = 0;
+        int fps = 30;
+        int bitrate = 2000000; // 2 Mbps
+        int crf = -1;          // constant quality instead of bitrate when >= 0
+        std::string codec;     // encoder name (libx264, libx265, ...), empty for the default H.264 one
+        std::string preset;    // x264 preset, empty keeps the encoder default
+        int threads = 0;       // 0 lets the encoder decide
+        std::string threadType; // "frame", "slice" or empty for the encoder default
+        bool adaptive = false; // allow reconfigure(): no B-frames, SPS/PPS identical for every preset
+        bool globalHeader = false; // out-of-band SPS/PPS even without a file, for sinks that mux
+    };
+
     class VideoEncoder
     {
     public:
@@ -22,18 +38,37 @@ namespace video_encoder
         ~VideoEncoder();
 
         bool initialize(const std::string &filename, int width, int height, int fps, int bitrate);
+        // An empty filename encodes without writing a file, packets only go to the callback
+        bool initialize(const std::string &filename, const EncoderSettings &settings);
         bool encodeFrame(const uint8_t *rgb_buffer, int width, int height);
+        // Encodes a YUV420P frame whose pts is in 1/fps units
+        bool encodeFrame(const AVFrame *frame);
+        // Drains the running encoder and reopens it with another preset. The
+        // new encoder starts on a keyframe with the same SPS/PPS (libx264),
+        // so the output file and its stored headers stay valid.
+        bool reconfigure(const std::string &preset);
+        void setPacketCallback(screen_recorder::PacketCallback callback);
+        const EncoderSettings &settings() const { return mSettings; }
+        const AVCodec *codec() const { return mCodec; }
+        const AVCodecContext *codecContext() const { return mCodecContext; }
         void finalize();
 
     private:
+        AVCodecContext *openCodec(const EncoderSettings &settings);
+        bool drainPackets(AVCodecContext *codecContext);
+
         AVFormatContext *mFormatContext;
         AVStream *mVideoStream;
         AVCodecContext *mCodecContext;
         AVFrame *mFrame;
         SwsContext *mSwsContext;
+        AVPacket *mPacket;
+        const AVCodec *mCodec;
+        EncoderSettings mSettings;
+        screen_recorder::PacketCallback mPacketCallback;
         int mFrameIndex;
         bool mInitialized;
     };
 }
 
-#endif // VIDEO_ENCODER_H
\ No newline at end of file
+#endif // VIDEO_ENCODER_H
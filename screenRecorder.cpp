@@ -1,9 +1,211 @@
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "include/desktopCapturer.h"
+#include "include/replaySource.h"
+#include "include/clipExtractor.h"
 
+namespace
+{
+    struct Options
+    {
+        Window window = None;
+        std::string source;
+        std::string output = "output.mp4";
+        std::string dumpRaw;
+        std::string trace;
+        std::vector<std::string> tees;
+        int fps = 0; // 0: source rate, or 30 for windows
+        int duration = 10;
+        int slices = 0; // 0: automatic
+        int timeLapse = 0; // idle sampling rate, 0: off
+        screen_recorder::CaptureRegion crop; // empty: whole window
+        int outputWidth = 0; // 0: captured size
+        int outputHeight = 0;
+        bool list = false;
+        bool adaptive = false;
+        bool composite = false;
+    };
+
+    void printUsage(const char *program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+                  << "  --window <id>       record this window (default: first capturable window)\n"
+                  << "  --source <spec>     synthetic:<text|noise|static>:<W>x<H>[@fps] or replay:<file>\n"
+                  << "  --output <file>     file written under out/ (default: output.mp4)\n"
+                  << "  --fps <n>           capture rate (default: 30, or the source's own rate)\n"
+                  << "  --crop <x>,<y>,<W>x<H>  record only this part of the window\n"
+                  << "  --scale <W>x<H>     encode at this size, 0 for one side keeps the aspect ratio\n"
+                  << "  --duration <s>      recording length, 0 records until interrupted (default: 10)\n"
+                  << "  --dump-raw <file>   also store the captured frames for replay\n"
+                  << "  --trace <file>      write a per-frame timeline of all threads as Chrome trace JSON\n"
+                  << "  --tee <url>         also send the encoded stream here (file or tcp://, udp://, ...), repeatable\n"
+                  << "  --adaptive          lower encoder preset and frame rate when the host cannot keep up\n"
+                  << "  --timelapse <fps>   sample at this rate while the screen is idle, full rate on activity\n"
+                  << "  --slices <n>        threads for colour conversion (default: automatic)\n"
+                  << "  --composite         read the window's offscreen pixmap instead of the on-screen pixels\n"
+                  << "  --list              list capturable windows and exit\n"
+                  << "\n"
+                  << "       " << program << " clip <recording> <start-s> <end-s> <output>\n"
+                  << "  cut a time range out of a recording without re-encoding" << std::endl;
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--window" && hasValue)
+                options.window = std::stoul(argv[++i], nullptr, 0);
+            else if (arg == "--source" && hasValue)
+                options.source = argv[++i];
+            else if (arg == "--output" && hasValue)
+                options.output = argv[++i];
+            else if (arg == "--fps" && hasValue)
+                options.fps = std::stoi(argv[++i]);
+            else if (arg == "--duration" && hasValue)
+                options.duration = std::stoi(argv[++i]);
+            else if (arg == "--dump-raw" && hasValue)
+                options.dumpRaw = argv[++i];
+            else if (arg == "--trace" && hasValue)
+                options.trace = argv[++i];
+            else if (arg == "--tee" && hasValue)
+                options.tees.push_back(argv[++i]);
+            else if (arg == "--crop" && hasValue)
+            {
+                if (std::sscanf(argv[++i], "%d,%d,%dx%d", &options.crop.x, &options.crop.y,
+                                &options.crop.width, &options.crop.height) != 4 ||
+                    options.crop.isEmpty())
+                    return false;
+            }
+            else if (arg == "--scale" && hasValue)
+            {
+                if (std::sscanf(argv[++i], "%dx%d", &options.outputWidth, &options.outputHeight) != 2)
+                    return false;
+            }
+            else if (arg == "--timelapse" && hasValue)
+                options.timeLapse = std::stoi(argv[++i]);
+            else if (arg == "--slices" && hasValue)
+                options.slices = std::stoi(argv[++i]);
+            else if (arg == "--composite")
+                options.composite = true;
+            else if (arg == "--adaptive")
+                options.adaptive = true;
+            else if (arg == "--list")
+                options.list = true;
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv){
+    if (argc > 1 && std::string(argv[1]) == "clip")
+    {
+        if (argc != 6)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        try
+        {
+            return screen_recorder::extractClip(argv[2], std::stod(argv[3]), std::stod(argv[4]), argv[5]) ? 0 : 1;
+        }
+        catch (const std::exception &)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    Options options;
+    try
+    {
+        if (!parseOptions(argc, argv, options))
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        screen_recorder::DesktopCapture desktopCapture(options.source.empty());
+        desktopCapture.setAdaptiveQuality(options.adaptive);
+        desktopCapture.setConversionSlices(options.slices);
+        desktopCapture.setTimeLapse(options.timeLapse);
+        desktopCapture.setCrop(options.crop);
+        desktopCapture.setOutputSize(options.outputWidth, options.outputHeight);
+        desktopCapture.setTracePath(options.trace);
+        desktopCapture.setCompositeCapture(options.composite);
+        for (const std::string &url : options.tees)
+            desktopCapture.addPacketSink(std::make_shared<screen_recorder::MuxerSink>(url));
+
+        screen_recorder::RawFrameWriter rawWriter;
+        bool rawWriterOpened = false;
+        if (!options.dumpRaw.empty())
+        {
+            desktopCapture.setFrameCallback([&](const std::shared_ptr<const screen_recorder::Frame> &frame)
+                                            {
+                                                // Whatever index comes first: grabs can fail or ticks be skipped
+                                                if (!rawWriterOpened)
+                                                {
+                                                    rawWriterOpened = true;
+                                                    rawWriter.open(options.dumpRaw, frame->width, frame->height, desktopCapture.getCaptureFps());
+                                                }
+                                                rawWriter.write(*frame);
+                                            });
+        }
+
+        if (!options.source.empty())
+        {
+            auto source = screen_recorder::createSourceFromSpec(options.source, options.fps);
+            if (!source)
+                return 1;
+            if (!options.crop.isEmpty())
+                source = std::make_unique<screen_recorder::CroppedSource>(std::move(source), options.crop);
+            desktopCapture.startCapture(std::move(source), options.output, options.fps, options.duration);
+            return 0;
+        }
+
+        if (options.list)
+        {
+            desktopCapture.printWindowInfo();
+            return 0;
+        }
+
+        int fps = options.fps > 0 ? options.fps : 30;
+        Window window = options.window;
+        if (window == None)
+        {
+            // No target given: list the windows and pick one as an example.
+            // With --window none of this runs and capture starts right away.
+            desktopCapture.printWindowInfo();
+            const auto &windows = desktopCapture.getCapturableWindows();
+            if (windows.size() < 2)
+            {
+                std::cerr << "No capturable window found." << std::endl;
+                return 1;
+            }
+            window = windows[1];
+            desktopCapture.captureThumbnail(window, "output.jpg");
+        }
+        desktopCapture.startCapture(window, options.output, fps, options.duration);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-int main(){
-    screen_recorder::DesktopCapture desktopCapture;
-    
     return 0;
-}
\ No newline at end of file
+}
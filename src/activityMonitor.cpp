@@ -0,0 +1,179 @@
+#include "activityMonitor.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    constexpr int kTileSize = 64;
+    // Every 4th row still catches a line of text or a moved window edge,
+    // which is enough to tell activity; the other rows are only hashed whole
+    constexpr int kRowStep = 4;
+    // Share of tiles that has to change to count as activity. Below it a
+    // frame is still encoded, but a blinking caret or a ticking clock does
+    // not keep the full rate going.
+    constexpr double kActiveShare = 0.01;
+    constexpr double kHoldSeconds = 3.0;
+    constexpr auto kInputPollInterval = std::chrono::milliseconds(100);
+
+    constexpr uint64_t kHashSeed = 14695981039346656037ull; // FNV-1a
+    constexpr uint64_t kHashPrime = 1099511628211ull;
+    constexpr uint64_t kPixelPairMask = 0x00ffffff00ffffffull; // the X byte is undefined
+
+    // Folds a row into four independent FNV-1a lanes so the multiplies overlap
+    void hashRow(const uint8_t *row, int width, uint64_t lanes[4])
+    {
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            for (int lane = 0; lane < 4; lane++)
+            {
+                uint64_t pixels;
+                std::memcpy(&pixels, row + (x + lane * 2) * 4, sizeof(pixels));
+                lanes[lane] = (lanes[lane] ^ (pixels & kPixelPairMask)) * kHashPrime;
+            }
+        }
+        for (; x < width; x++)
+        {
+            uint32_t pixel;
+            std::memcpy(&pixel, row + x * 4, sizeof(pixel));
+            lanes[0] = (lanes[0] ^ (pixel & 0x00ffffff)) * kHashPrime;
+        }
+    }
+}
+
+namespace screen_recorder
+{
+    ActivityMonitor::ActivityMonitor(int fps, int idleFps, Display *display)
+        : mFps(std::max(fps, 1)), mIdleFps(std::clamp(idleFps, 1, std::max(fps, 1))), mDisplay(display),
+          mActive(false), mLastActivity(std::chrono::steady_clock::now()), mLastInputPoll(),
+          mPreviousRowsHash(0),
+          mPointerX(0), mPointerY(0), mPointerMask(0), mKeys{}
+    {
+        // Baseline for the input comparison
+        if (mDisplay)
+            inputChanged();
+    }
+
+    bool ActivityMonitor::sample(const Frame &frame)
+    {
+        int tilesX = (frame.width + kTileSize - 1) / kTileSize;
+        int tilesY = (frame.height + kTileSize - 1) / kTileSize;
+        mSignature.assign(static_cast<size_t>(tilesX) * tilesY, kHashSeed);
+
+        uint64_t lanes[4] = {kHashSeed, kHashSeed, kHashSeed, kHashSeed};
+        for (int y = 0; y < frame.height; y++)
+        {
+            const uint8_t *row = frame.data[0] + static_cast<size_t>(y) * frame.stride[0];
+            if (y % kRowStep != 0)
+            {
+                hashRow(row, frame.width, lanes);
+                continue;
+            }
+            uint64_t *tiles = mSignature.data() + static_cast<size_t>(y / kTileSize) * tilesX;
+            // Two pixels at a time; a pair never straddles a tile
+            int x = 0;
+            for (; x + 1 < frame.width; x += 2)
+            {
+                uint64_t pixels;
+                std::memcpy(&pixels, row + x * 4, sizeof(pixels));
+                uint64_t &hash = tiles[x / kTileSize];
+                hash = (hash ^ (pixels & kPixelPairMask)) * kHashPrime;
+            }
+            if (x < frame.width)
+            {
+                uint32_t pixel;
+                std::memcpy(&pixel, row + x * 4, sizeof(pixel));
+                uint64_t &hash = tiles[x / kTileSize];
+                hash = (hash ^ (pixel & 0x00ffffff)) * kHashPrime;
+            }
+        }
+
+        uint64_t rowsHash = ((lanes[0] * kHashPrime ^ lanes[1]) * kHashPrime ^ lanes[2]) * kHashPrime ^ lanes[3];
+
+        bool changed = true;
+        if (mSignature.size() == mPreviousSignature.size())
+        {
+            size_t changedTiles = 0;
+            for (size_t i = 0; i < mSignature.size(); i++)
+                changedTiles += mSignature[i] != mPreviousSignature[i];
+            // A change in the skipped rows alone is content, not activity
+            changed = changedTiles > 0 || rowsHash != mPreviousRowsHash;
+            if (changedTiles >= std::max<size_t>(1, static_cast<size_t>(mSignature.size() * kActiveShare)))
+                markActivity("screen content changed");
+        }
+        mSignature.swap(mPreviousSignature);
+        mPreviousRowsHash = rowsHash;
+
+        if (mActive && std::chrono::steady_clock::now() - mLastActivity > std::chrono::duration<double>(kHoldSeconds))
+        {
+            mActive = false;
+            std::cout << "Activity monitor: idle for " << kHoldSeconds << " s, sampling at " << mIdleFps << " fps" << std::endl;
+        }
+        return changed;
+    }
+
+    bool ActivityMonitor::waitUntil(std::chrono::steady_clock::time_point deadline)
+    {
+        if (!mDisplay)
+        {
+            std::this_thread::sleep_until(deadline);
+            return false;
+        }
+        for (auto now = std::chrono::steady_clock::now(); now < deadline; now = std::chrono::steady_clock::now())
+        {
+            // At the full rate this polls every few frames rather than every frame
+            auto nextPoll = mLastInputPoll + kInputPollInterval;
+            if (now < nextPoll)
+            {
+                std::this_thread::sleep_until(std::min(deadline, nextPoll));
+                continue;
+            }
+            if (inputChanged())
+            {
+                markActivity("input activity");
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int ActivityMonitor::tickStep() const
+    {
+        return mActive ? 1 : std::max(1, mFps / mIdleFps);
+    }
+
+    bool ActivityMonitor::inputChanged()
+    {
+        // Two round trips; pressed keys and buttons count for as long as they are held
+        mLastInputPoll = std::chrono::steady_clock::now();
+        Window root, child;
+        int rootX = 0, rootY = 0, windowX, windowY;
+        unsigned int mask = 0;
+        XQueryPointer(mDisplay, DefaultRootWindow(mDisplay), &root, &child, &rootX, &rootY, &windowX, &windowY, &mask);
+        char keys[32];
+        XQueryKeymap(mDisplay, keys);
+
+        bool pointerMoved = rootX != mPointerX || rootY != mPointerY || mask != mPointerMask;
+        bool keyboardUsed = std::memcmp(keys, mKeys, sizeof(keys)) != 0 ||
+                            std::any_of(keys, keys + sizeof(keys), [](char k)
+                                        { return k != 0; });
+        mPointerX = rootX;
+        mPointerY = rootY;
+        mPointerMask = mask;
+        std::memcpy(mKeys, keys, sizeof(keys));
+
+        return pointerMoved || keyboardUsed;
+    }
+
+    void ActivityMonitor::markActivity(const char *reason)
+    {
+        mLastActivity = std::chrono::steady_clock::now();
+        if (!mActive)
+        {
+            mActive = true;
+            std::cout << "Activity monitor: " << reason << ", sampling at " << mFps << " fps" << std::endl;
+        }
+    }
+}
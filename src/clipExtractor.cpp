@@ -0,0 +1,191 @@
+#include "clipExtractor.h"
+#include "keyframeIndex.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+namespace
+{
+    // Where the demuxer's timestamps start. The recorder muxes from zero, but
+    // MPEG-TS for one shifts everything by the mux delay on the way out.
+    int64_t streamOrigin(const AVStream *stream)
+    {
+        return stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    }
+
+    // Clip times count from the start of the recording
+    int64_t toStreamTime(double seconds, const AVStream *stream)
+    {
+        return streamOrigin(stream) + std::llround(seconds * stream->time_base.den / stream->time_base.num);
+    }
+
+    // Positions the demuxer on the keyframe the clip starts from
+    bool seekToStart(AVFormatContext *inputContext, const AVStream *stream, const std::string &input, int64_t start)
+    {
+        screen_recorder::KeyframeIndex index;
+        const screen_recorder::KeyframeIndexEntry *keyframe = nullptr;
+        if (index.load(screen_recorder::keyframeIndexPath(input)) &&
+            index.header().timeBaseNum == stream->time_base.num &&
+            index.header().timeBaseDen == stream->time_base.den)
+        {
+            // The index holds the timestamps as they went into the muxer
+            keyframe = index.findAtOrBefore(start - streamOrigin(stream));
+        }
+
+        if (!keyframe)
+        {
+            // No usable index: let the demuxer search its own tables
+            std::cout << "No keyframe index for " << input << ", seeking by timestamp" << std::endl;
+            return av_seek_frame(inputContext, stream->index, start, AVSEEK_FLAG_BACKWARD) >= 0;
+        }
+
+        if (!(inputContext->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+            av_seek_frame(inputContext, stream->index, keyframe->byteOffset, AVSEEK_FLAG_BYTE) >= 0)
+            return true;
+
+        // MP4 and friends only seek by time; the keyframe's own dts is an exact hit
+        return av_seek_frame(inputContext, stream->index, streamOrigin(stream) + keyframe->dts, AVSEEK_FLAG_BACKWARD) >= 0;
+    }
+}
+
+namespace screen_recorder
+{
+    bool extractClip(const std::string &input, double startSeconds, double endSeconds, const std::string &output)
+    {
+        if (startSeconds < 0 || endSeconds <= startSeconds)
+        {
+            std::cerr << "Invalid clip range " << startSeconds << "-" << endSeconds << std::endl;
+            return false;
+        }
+        auto startTime = std::chrono::steady_clock::now();
+
+        // No avformat_find_stream_info: it decodes frames, and the container
+        // already describes the stream well enough for a copy
+        AVFormatContext *inputContext = nullptr;
+        if (avformat_open_input(&inputContext, input.c_str(), nullptr, nullptr) < 0)
+        {
+            std::cerr << "Failed to open recording: " << input << std::endl;
+            return false;
+        }
+
+        AVStream *inputStream = nullptr;
+        for (unsigned i = 0; i < inputContext->nb_streams && !inputStream; i++)
+        {
+            if (inputContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                inputStream = inputContext->streams[i];
+        }
+        if (!inputStream)
+        {
+            std::cerr << "No video stream in " << input << std::endl;
+            avformat_close_input(&inputContext);
+            return false;
+        }
+
+        int64_t start = toStreamTime(startSeconds, inputStream);
+        int64_t end = toStreamTime(endSeconds, inputStream);
+        if (!seekToStart(inputContext, inputStream, input, start))
+        {
+            std::cerr << "Failed to seek to " << startSeconds << "s in " << input << std::endl;
+            avformat_close_input(&inputContext);
+            return false;
+        }
+
+        AVFormatContext *outputContext = nullptr;
+        avformat_alloc_output_context2(&outputContext, nullptr, nullptr, output.c_str());
+        if (!outputContext)
+        {
+            std::cerr << "Failed to create format context" << std::endl;
+            avformat_close_input(&inputContext);
+            return false;
+        }
+
+        AVStream *outputStream = avformat_new_stream(outputContext, nullptr);
+        bool ok = outputStream && avcodec_parameters_copy(outputStream->codecpar, inputStream->codecpar) >= 0;
+        if (ok)
+        {
+            // Let the output container pick its own tag for the codec
+            outputStream->codecpar->codec_tag = 0;
+            outputStream->time_base = inputStream->time_base;
+            if (!(outputContext->oformat->flags & AVFMT_NOFILE))
+                ok = avio_open(&outputContext->pb, output.c_str(), AVIO_FLAG_WRITE) >= 0;
+        }
+        if (!ok || avformat_write_header(outputContext, nullptr) < 0)
+        {
+            std::cerr << "Failed to open clip output: " << output << std::endl;
+            if (outputContext->pb)
+                avio_closep(&outputContext->pb);
+            avformat_free_context(outputContext);
+            avformat_close_input(&inputContext);
+            return false;
+        }
+
+        AVPacket *packet = av_packet_alloc();
+        int64_t offset = AV_NOPTS_VALUE;
+        int64_t clipStart = 0;
+        int packets = 0;
+        while (av_read_frame(inputContext, packet) >= 0)
+        {
+            if (packet->stream_index != inputStream->index)
+            {
+                av_packet_unref(packet);
+                continue;
+            }
+            // Decoding order: once dts passes the end nothing shown before it follows
+            if (packet->dts != AV_NOPTS_VALUE && packet->dts >= end)
+            {
+                av_packet_unref(packet);
+                break;
+            }
+            if (offset == AV_NOPTS_VALUE)
+            {
+                // A byte seek may land before the keyframe boundary
+                if (!(packet->flags & AV_PKT_FLAG_KEY))
+                {
+                    av_packet_unref(packet);
+                    continue;
+                }
+                offset = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+                clipStart = packet->pts != AV_NOPTS_VALUE ? packet->pts : offset;
+            }
+
+            // Shift the clip to start at zero
+            if (packet->pts != AV_NOPTS_VALUE)
+                packet->pts -= offset;
+            if (packet->dts != AV_NOPTS_VALUE)
+                packet->dts -= offset;
+            av_packet_rescale_ts(packet, inputStream->time_base, outputContext->streams[0]->time_base);
+            packet->stream_index = 0;
+            packet->pos = -1;
+            av_interleaved_write_frame(outputContext, packet);
+            av_packet_unref(packet);
+            packets++;
+        }
+        av_packet_free(&packet);
+        clipStart -= streamOrigin(inputStream);
+        double clipStartSeconds = static_cast<double>(clipStart) * inputStream->time_base.num / inputStream->time_base.den;
+
+        av_write_trailer(outputContext);
+        if (!(outputContext->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&outputContext->pb);
+        avformat_free_context(outputContext);
+        avformat_close_input(&inputContext);
+
+        if (packets == 0)
+        {
+            std::cerr << "No frames in " << startSeconds << "-" << endSeconds << "s of " << input << std::endl;
+            return false;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+        std::cout << "Clip written: " << output << " (" << packets << " packets from keyframe at "
+                  << clipStartSeconds << "s, " << elapsed.count() << " ms)" << std::endl;
+        return true;
+    }
+}
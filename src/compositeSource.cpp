@@ -0,0 +1,263 @@
+#include "compositeSource.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#ifdef HAVE_XCOMPOSITE
+#include <X11/extensions/Xcomposite.h>
+#endif
+
+namespace screen_recorder
+{
+#ifdef HAVE_XCOMPOSITE
+    namespace
+    {
+        class ErrorTrap;
+
+        // Xlib has one error handler per process, shared with the embedding
+        // application and other sessions. It is installed while any trap
+        // exists and hands every error it does not own to the previous one.
+        std::mutex gTrapsMutex;
+        std::vector<ErrorTrap *> gTraps;
+        int (*gPreviousHandler)(Display *, XErrorEvent *) = nullptr;
+
+        int compositeErrorHandler(Display *display, XErrorEvent *error);
+
+        // Errors on a window that went away must not take the process down
+        // through Xlib's default handler; they just fail the request. Only
+        // errors of our own connection from requests issued since the trap
+        // was set count, and only requests with a reply (or followed by
+        // XSync) report in time.
+        class ErrorTrap
+        {
+        public:
+            explicit ErrorTrap(Display *display)
+                : mDisplay(display), mSerial(NextRequest(display)), mFailed(false)
+            {
+                std::lock_guard<std::mutex> lock(gTrapsMutex);
+                if (gTraps.empty())
+                    gPreviousHandler = XSetErrorHandler(compositeErrorHandler);
+                gTraps.push_back(this);
+            }
+            ~ErrorTrap()
+            {
+                std::lock_guard<std::mutex> lock(gTrapsMutex);
+                gTraps.erase(std::find(gTraps.begin(), gTraps.end(), this));
+                if (gTraps.empty())
+                    XSetErrorHandler(gPreviousHandler);
+            }
+            ErrorTrap(const ErrorTrap &) = delete;
+            ErrorTrap &operator=(const ErrorTrap &) = delete;
+
+            bool failed() const { return mFailed; }
+            bool claim(Display *display, const XErrorEvent *error)
+            {
+                if (display != mDisplay || error->serial < mSerial)
+                    return false;
+                mFailed = true;
+                return true;
+            }
+
+        private:
+            Display *mDisplay;
+            unsigned long mSerial;
+            std::atomic<bool> mFailed;
+        };
+
+        int compositeErrorHandler(Display *display, XErrorEvent *error)
+        {
+            int (*previous)(Display *, XErrorEvent *);
+            {
+                std::lock_guard<std::mutex> lock(gTrapsMutex);
+                // Newest first, so nested traps on one connection get their own errors
+                for (auto it = gTraps.rbegin(); it != gTraps.rend(); it++)
+                {
+                    if ((*it)->claim(display, error))
+                        return 0;
+                }
+                previous = gPreviousHandler;
+            }
+            return previous ? previous(display, error) : 0;
+        }
+    }
+
+    CompositeSource::CompositeSource(Display *display, Window window, int x, int y, int width, int height)
+        : mDisplay(display), mWindow(window), mX(x), mY(y), mWidth(width), mHeight(height),
+          mVisual(nullptr), mDepth(0), mRedirected(false), mPixmap(None),
+          mPixmapWidth(0), mPixmapHeight(0)
+    {
+        XWindowAttributes attrs;
+        if (!XGetWindowAttributes(display, window, &attrs))
+            return;
+        mVisual = attrs.visual;
+        mDepth = attrs.depth;
+
+        ErrorTrap trap(display);
+        // Automatic keeps the window on screen as before; a running
+        // compositing manager already redirects it and this only adds a reference
+        XCompositeRedirectWindow(display, window, CompositeRedirectAutomatic);
+        // ConfigureNotify tells us when the pixmap has to be named again
+        XSelectInput(display, window, StructureNotifyMask);
+        XSync(display, False);
+        if (trap.failed())
+        {
+            std::cerr << "Failed to redirect window " << window << " for composite capture" << std::endl;
+            return;
+        }
+        mRedirected = true;
+        acquirePixmap();
+    }
+
+    CompositeSource::~CompositeSource()
+    {
+        ErrorTrap trap(mDisplay);
+        releasePixmap();
+        if (mRedirected)
+        {
+            XSelectInput(mDisplay, mWindow, NoEventMask);
+            XCompositeUnredirectWindow(mDisplay, mWindow, CompositeRedirectAutomatic);
+        }
+        XSync(mDisplay, False);
+    }
+
+    bool CompositeSource::isSupported(Display *display)
+    {
+        int eventBase, errorBase, major = 0, minor = 2;
+        // NameWindowPixmap needs 0.2
+        return XCompositeQueryExtension(display, &eventBase, &errorBase) &&
+               XCompositeQueryVersion(display, &major, &minor) &&
+               (major > 0 || minor >= 2);
+    }
+
+    bool CompositeSource::acquirePixmap()
+    {
+        releasePixmap();
+
+        XWindowAttributes attrs;
+        ErrorTrap trap(mDisplay);
+        if (!XGetWindowAttributes(mDisplay, mWindow, &attrs) || attrs.map_state != IsViewable)
+            return false; // unmapped windows have no pixmap
+
+        mPixmap = XCompositeNameWindowPixmap(mDisplay, mWindow);
+        XSync(mDisplay, False);
+        if (trap.failed())
+        {
+            mPixmap = None;
+            return false;
+        }
+
+        // The pixmap includes the border; the region is relative to the client area inside it
+        int border = attrs.border_width;
+        mPixmapWidth = attrs.width + 2 * border;
+        mPixmapHeight = attrs.height + 2 * border;
+        int width = std::min(mWidth, attrs.width - mX);
+        int height = std::min(mHeight, attrs.height - mY);
+        if (width <= 0 || height <= 0)
+            return false; // shrunk past the captured region, keep the pixmap for checkResize
+        mSource = createXSource(mDisplay, mPixmap, mX + border, mY + border, width, height, mVisual, mDepth);
+        return true;
+    }
+
+    void CompositeSource::releasePixmap()
+    {
+        mSource.reset();
+        if (mPixmap != None)
+        {
+            XFreePixmap(mDisplay, mPixmap);
+            mPixmap = None;
+        }
+    }
+
+    void CompositeSource::checkResize()
+    {
+        // Only the newest configuration matters; moves don't touch the pixmap
+        XEvent event;
+        bool resized = false;
+        while (XCheckTypedWindowEvent(mDisplay, mWindow, ConfigureNotify, &event))
+        {
+            int width = event.xconfigure.width + 2 * event.xconfigure.border_width;
+            int height = event.xconfigure.height + 2 * event.xconfigure.border_width;
+            resized = width != mPixmapWidth || height != mPixmapHeight;
+        }
+        if (resized)
+        {
+            std::cout << "Window " << mWindow << " resized, acquiring its new pixmap" << std::endl;
+            acquirePixmap();
+        }
+    }
+
+    std::shared_ptr<const Frame> CompositeSource::grab(uint64_t index)
+    {
+        if (!mRedirected)
+            return nullptr;
+        checkResize();
+        if (!mSource && !acquirePixmap())
+            return nullptr;
+
+        std::shared_ptr<const Frame> frame;
+        {
+            ErrorTrap trap(mDisplay);
+            frame = mSource->grab(index);
+            if (trap.failed())
+                frame = nullptr;
+        }
+        if (!frame)
+        {
+            // Most likely unmapped or destroyed; try a fresh pixmap next time
+            releasePixmap();
+            return nullptr;
+        }
+        if (frame->width == mWidth && frame->height == mHeight)
+            return frame;
+
+        // Smaller than when recording started: pad to the output size
+        auto buffer = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(mWidth) * mHeight * 4);
+        for (int y = 0; y < frame->height; y++)
+            std::memcpy(buffer->data() + static_cast<size_t>(y) * mWidth * 4,
+                        frame->data[0] + static_cast<size_t>(y) * frame->stride[0], frame->width * 4);
+
+        auto padded = std::make_shared<Frame>(*frame);
+        padded->width = mWidth;
+        padded->height = mHeight;
+        padded->data[0] = buffer->data();
+        padded->stride[0] = mWidth * 4;
+        padded->owner = buffer;
+        return padded;
+    }
+#else
+    CompositeSource::CompositeSource(Display *display, Window window, int x, int y, int width, int height)
+        : mDisplay(display), mWindow(window), mX(x), mY(y), mWidth(width), mHeight(height),
+          mVisual(nullptr), mDepth(0), mRedirected(false), mPixmap(None),
+          mPixmapWidth(0), mPixmapHeight(0)
+    {
+    }
+
+    CompositeSource::~CompositeSource() = default;
+
+    bool CompositeSource::isSupported(Display *)
+    {
+        return false;
+    }
+
+    bool CompositeSource::acquirePixmap()
+    {
+        return false;
+    }
+
+    void CompositeSource::releasePixmap()
+    {
+    }
+
+    void CompositeSource::checkResize()
+    {
+    }
+
+    std::shared_ptr<const Frame> CompositeSource::grab(uint64_t)
+    {
+        return nullptr;
+    }
+#endif
+}
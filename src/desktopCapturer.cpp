@@ -2,6 +2,14 @@
 #include "windowUtils.h"
 #include "imageUtils.h"
 #include "videoEncoder.h"
+#include "frameSource.h"
+#include "compositeSource.h"
+#include "loadController.h"
+#include "sliceConverter.h"
+#include "packetFanout.h"
+#include "activityMonitor.h"
+#include "frameTracer.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
@@ -10,6 +18,10 @@
 #include <libyuv.h>
 #include <jpeglib.h>
 #include <filesystem>
+#include <stdexcept>
+#include <chrono>
+#include <deque>
+#include <future>
 
 extern "C"
 {
@@ -22,6 +34,19 @@ extern "C"
 
 namespace
 {
+    constexpr int kTimeLapseKeepAliveSeconds = 10;
+    // Converted frames held while the encoder is still opening
+    constexpr size_t kMaxEarlyFrames = 8;
+
+    AVFrame *allocateFrame(int width, int height)
+    {
+        AVFrame *frame = av_frame_alloc();
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = width;
+        frame->height = height;
+        av_frame_get_buffer(frame, 0);
+        return frame;
+    }
 
     bool isWindowCapturable(Display *display, Window window)
     {
@@ -122,38 +147,65 @@ namespace
 
 namespace screen_recorder
 {
-    DesktopCapture::DesktopCapture()
+    DesktopCapture::DesktopCapture(bool connectDisplay)
+        : mRootWindow(None), mScreenWidth(0), mScreenHeight(0),
+          mWindowAttributes(), mWindowsListed(false)
     {
         // Initialize the desktop capture functionality
-        std::cout << "DesktopCapture initialized." << std::endl;
+        if (!connectDisplay)
+        {
+            // Headless session, only usable with synthetic or replay sources
+            std::cout << "DesktopCapture initialized without a display." << std::endl;
+            return;
+        }
+        // The capture loop may run on its own thread while callers enumerate
+        // windows, so Xlib has to be made thread-safe before the display opens.
+        XInitThreads();
         mDisplay = std::unique_ptr<Display, DisplayDeleter>(XOpenDisplay(nullptr));
         if (!mDisplay)
         {
-            std::cerr << "Failed to open X display." << std::endl;
-            std::exit(EXIT_FAILURE);
+            throw std::runtime_error("Failed to open X display.");
         }
         mRootWindow = DefaultRootWindow(mDisplay.get());
         if (mRootWindow == None)
         {
-            std::cerr << "Failed to get root window." << std::endl;
-            std::exit(EXIT_FAILURE);
+            throw std::runtime_error("Failed to get root window.");
         }
         if (XGetWindowAttributes(mDisplay.get(), mRootWindow, &mWindowAttributes) == 0)
         {
-            std::cerr << "Failed to get window attributes." << std::endl;
-            std::exit(EXIT_FAILURE);
+            throw std::runtime_error("Failed to get window attributes.");
         }
         mScreenWidth = mWindowAttributes.width;
         mScreenHeight = mWindowAttributes.height;
+        // Windows are only enumerated when asked for; walking the whole tree
+        // costs a round trip per window, which recording a known window never needs
+        std::cout << "DesktopCapture initialized." << std::endl;
+    }
+    DesktopCapture::~DesktopCapture()
+    {
+        // Clean up resources if necessary
+        stopCapture();
+        std::cout << "DesktopCapture destroyed." << std::endl;
+    }
+    const std::vector<Window> &DesktopCapture::getCapturableWindows() const
+    {
+        std::lock_guard<std::mutex> lock(mWindowsMutex);
+        if (!mWindowsListed && mDisplay)
+            getAllWindows(mDisplay.get(), mRootWindow, mCapturableWindows);
+        mWindowsListed = true;
+        return mCapturableWindows;
+    }
+    void DesktopCapture::printWindowInfo()
+    {
+        const std::vector<Window> &windows = getCapturableWindows();
         std::cout << "Screen dimensions: " << mScreenWidth << "x" << mScreenHeight << std::endl;
-        getAllWindows(mDisplay.get(), mRootWindow, mCapturableWindows);
         std::cout << "\n=== All Windows ===" << std::endl;
-        std::cout << "Total windows found: " << mCapturableWindows.size() << std::endl;
+        std::cout << "Total windows found: " << windows.size() << std::endl;
 
         std::cout << "\n=== Capturable Windows ===" << std::endl;
         int capturable_count = 0;
 
-        for (auto windowId : mCapturableWindows)
+        for (auto windowId : windows)
         {
             XWindowAttributes attrs;
             if (XGetWindowAttributes(mDisplay.get(), windowId, &attrs) == 0)
@@ -166,7 +218,6 @@ namespace screen_recorder
 
             std::string windowClass = getWindowClass(mDisplay.get(), windowId);
 
-            mCapturableWindows.push_back(windowId);
             capturable_count++;
             std::cout << "\n--- Window #" << capturable_count << " ---" << std::endl;
             std::cout << "ID: " << windowId << std::endl;
@@ -190,284 +241,626 @@ namespace screen_recorder
         }
 
         std::cout << "\n=== Summary ===" << std::endl;
-        std::cout << "Total windows: " << mCapturableWindows.size() << std::endl;
+        std::cout << "Total windows: " << windows.size() << std::endl;
         std::cout << "Capturable windows: " << capturable_count << std::endl;
-        captureThumbnail(mCapturableWindows[1], "output.jpg"); // Start capturing the first capturable window as an example
-        startCapture(mCapturableWindows[1], "output.mp4", 30, 10); // Start video recording for the first capturable window
-        std::cout << "DesktopCapture initialized successfully." << std::endl;
     }
-    DesktopCapture::~DesktopCapture()
+    void DesktopCapture::setFrameCallback(FrameCallback callback, PixelFormat format)
     {
-        // Clean up resources if necessary
-        std::cout << "DesktopCapture destroyed." << std::endl;
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mFrameCallback = std::move(callback);
+        mFrameCallbackFormat = format;
     }
-    void DesktopCapture::startCapture(Window windowId, const std::string &filename, int fps, int duration_seconds)
+    void DesktopCapture::setFrameRing(std::shared_ptr<FrameRingWriter> ring)
     {
-        std::cout << "Starting video recording for window ID: " << windowId << std::endl;
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mFrameRing = std::move(ring);
+    }
+    void DesktopCapture::setPacketCallback(PacketCallback callback)
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mPacketCallback = std::move(callback);
+    }
+    void DesktopCapture::setCompositeCapture(bool enabled)
+    {
+        mCompositeCapture = enabled;
+    }
+    void DesktopCapture::setTimeLapse(int idleFps)
+    {
+        mTimeLapseFps = idleFps;
+    }
+    void DesktopCapture::setCrop(const CaptureRegion &region)
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mCrop = region;
+    }
+    void DesktopCapture::setTracePath(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mTracePath = path;
+    }
+    StartupTiming DesktopCapture::getStartupTiming() const
+    {
+        StartupTiming timing;
+        timing.firstFrameMs = mFirstFrameMs;
+        timing.firstPacketMs = mFirstPacketMs;
+        return timing;
+    }
+    void DesktopCapture::setOutputSize(int width, int height)
+    {
+        mOutputWidth = std::max(width, 0);
+        mOutputHeight = std::max(height, 0);
+    }
+    void DesktopCapture::setConversionSlices(int slices)
+    {
+        mConversionSlices = slices;
+    }
+    void DesktopCapture::setAdaptiveQuality(bool enabled)
+    {
+        mAdaptiveQuality = enabled;
+    }
+    void DesktopCapture::addPacketSink(std::shared_ptr<PacketSink> sink)
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mPacketSinks.push_back(std::move(sink));
+    }
+    void DesktopCapture::clearPacketSinks()
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        mPacketSinks.clear();
+    }
+    int DesktopCapture::getCaptureFps() const
+    {
+        return mCaptureFps;
+    }
+    bool DesktopCapture::isCapturing() const
+    {
+        return mCapturing;
+    }
+    bool DesktopCapture::wantsFrames(PixelFormat format)
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        return (mFrameCallback && mFrameCallbackFormat == format) ||
+               (mFrameRing && mFrameRing->format() == format);
+    }
+    void DesktopCapture::deliverFrame(const std::shared_ptr<const Frame> &frame)
+    {
+        // Called without the lock held, so a callback may replace itself
+        std::shared_ptr<FrameRingWriter> ring;
+        FrameCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mCallbackMutex);
+            if (mFrameRing && mFrameRing->format() == frame->format)
+                ring = mFrameRing;
+            if (mFrameCallback && mFrameCallbackFormat == frame->format)
+                callback = mFrameCallback;
+        }
+        if (ring)
+            ring->publish(*frame);
+        if (callback)
+            callback(frame);
+    }
+    void DesktopCapture::publishFrame(const AVFrame *converted, uint64_t index)
+    {
+        if (!wantsFrames(PixelFormat::I420))
+            return;
+
+        // A new reference to the encoder input; the capture loop makes the
+        // frame writable again before the next conversion, so holders keep
+        // the pixels they were given.
+        std::shared_ptr<AVFrame> reference(av_frame_clone(converted), [](AVFrame *f)
+                                           { av_frame_free(&f); });
+        if (!reference)
+            return;
+
+        auto frame = std::make_shared<Frame>();
+        frame->width = reference->width;
+        frame->height = reference->height;
+        frame->format = PixelFormat::I420;
+        for (int plane = 0; plane < 3; plane++)
+        {
+            frame->data[plane] = reference->data[plane];
+            frame->stride[plane] = reference->linesize[plane];
+        }
+        frame->timestampUs = steadyClockMicros();
+        frame->index = index;
+        frame->owner = reference;
+        deliverFrame(frame);
+    }
+    void DesktopCapture::publishPacket(const AVPacket *packet, int timeBaseNum, int timeBaseDen)
+    {
+        PacketCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mCallbackMutex);
+            callback = mPacketCallback;
+        }
+        if (callback)
+            callback(packet, timeBaseNum, timeBaseDen);
+    }
+    std::unique_ptr<FrameSource> DesktopCapture::createWindowSource(Window windowId)
+    {
+        if (!mDisplay)
+        {
+            std::cerr << "No X display to capture window ID: " << windowId << std::endl;
+            return nullptr;
+        }
 
         XWindowAttributes attrs;
         if (XGetWindowAttributes(mDisplay.get(), windowId, &attrs) == 0)
         {
             std::cerr << "Failed to get attributes for window ID: " << windowId << std::endl;
-            return;
+            return nullptr;
         }
 
-        int width = attrs.width;
-        int height = attrs.height;
-
-        // Make sure dimensions are even (required for many codecs)
-        width = (width + 1) & ~1;
-        height = (height + 1) & ~1;
-
-        std::cout << "Recording window: " << windowId << " with size: " << width << "x" << height << std::endl;
-
-        // Create output directory
-        std::filesystem::path outputDir = "out";
-        if (!std::filesystem::exists(outputDir))
+        CaptureRegion region{0, 0, attrs.width, attrs.height};
         {
-            std::filesystem::create_directories(outputDir);
-            std::cout << "Created output directory: " << outputDir << std::endl;
+            std::lock_guard<std::mutex> lock(mCallbackMutex);
+            if (!mCrop.isEmpty())
+            {
+                region.x = std::clamp(mCrop.x, 0, attrs.width);
+                region.y = std::clamp(mCrop.y, 0, attrs.height);
+                region.width = std::min(mCrop.width, attrs.width - region.x);
+                region.height = std::min(mCrop.height, attrs.height - region.y);
+            }
         }
-
-        AVFormatContext *formatContext = nullptr;
-        avformat_alloc_output_context2(&formatContext, nullptr, nullptr, ("out/" + filename).c_str());
-        if (!formatContext)
+        if (region.isEmpty())
         {
-            std::cerr << "Failed to create format context" << std::endl;
-            return;
+            std::cerr << "Crop region lies outside window ID: " << windowId << std::endl;
+            return nullptr;
         }
 
-        // Find H.264 encoder
-        const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-        if (!codec)
+        if (mCompositeCapture && CompositeSource::isSupported(mDisplay.get()))
         {
-            std::cerr << "H.264 codec not found" << std::endl;
-            avformat_free_context(formatContext);
-            return;
+            auto source = std::make_unique<CompositeSource>(mDisplay.get(), windowId, region.x, region.y, region.width, region.height);
+            if (source->isValid())
+                return source;
+            std::cerr << "Composite capture unavailable for window ID: " << windowId
+                      << ", grabbing on-screen pixels" << std::endl;
         }
-
-        // Create video stream
-        AVStream *stream = avformat_new_stream(formatContext, codec);
-        if (!stream)
+        return createXSource(mDisplay.get(), windowId, region.x, region.y, region.width, region.height);
+    }
+    bool DesktopCapture::startCaptureAsync(Window windowId, const std::string &filename, int fps, int duration_seconds)
+    {
+        auto requestedAt = std::chrono::steady_clock::now();
+        if (mCapturing)
         {
-            std::cerr << "Failed to create video stream" << std::endl;
-            avformat_free_context(formatContext);
-            return;
+            std::cerr << "Capture already running" << std::endl;
+            return false;
         }
+        auto source = createWindowSource(windowId);
+        if (!source)
+            return false;
+        return launchCapture(std::move(source), filename, fps, duration_seconds, requestedAt);
+    }
+    bool DesktopCapture::startCaptureAsync(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds)
+    {
+        return launchCapture(std::move(source), filename, fps, duration_seconds, std::chrono::steady_clock::now());
+    }
+    bool DesktopCapture::launchCapture(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds,
+                                       std::chrono::steady_clock::time_point requestedAt)
+    {
+        if (mCapturing)
+        {
+            std::cerr << "Capture already running" << std::endl;
+            return false;
+        }
+        if (mCaptureThread.joinable())
+            mCaptureThread.join();
 
-        // Configure codec context
-        AVCodecContext *codecContext = avcodec_alloc_context3(codec);
-        codecContext->width = width;
-        codecContext->height = height;
-        codecContext->time_base = {1, fps};
-        codecContext->framerate = {fps, 1};
-        codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
-        codecContext->bit_rate = 2000000; // 2 Mbps
-
-        // Some formats want stream headers to be separate
-        if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
-            codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-
-        // Open codec
-        if (avcodec_open2(codecContext, codec, nullptr) < 0)
+        mCapturing = true;
+        mCaptureThread = std::thread([this, source = std::move(source), filename, fps, duration_seconds, requestedAt]() mutable
+                                     { captureFrom(std::move(source), filename, fps, duration_seconds, requestedAt); });
+        return true;
+    }
+    void DesktopCapture::startCapture(Window windowId, const std::string &filename, int fps, int duration_seconds)
+    {
+        auto requestedAt = std::chrono::steady_clock::now();
+        std::cout << "Starting video recording for window ID: " << windowId << std::endl;
+        auto source = createWindowSource(windowId);
+        if (!source)
+            return;
+        captureFrom(std::move(source), filename, fps, duration_seconds, requestedAt);
+    }
+    void DesktopCapture::startCapture(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds)
+    {
+        captureFrom(std::move(source), filename, fps, duration_seconds, std::chrono::steady_clock::now());
+    }
+    void DesktopCapture::captureFrom(std::unique_ptr<FrameSource> source, const std::string &filename, int fps, int duration_seconds,
+                                     std::chrono::steady_clock::time_point requestedAt)
+    {
+        mCapturing = true;
+        runCapture(*source, filename, fps, duration_seconds, requestedAt);
+        mCapturing = false;
+        mStopRequested = false;
+    }
+    void DesktopCapture::runCapture(FrameSource &source, const std::string &filename, int fps, int duration_seconds,
+                                    std::chrono::steady_clock::time_point requestedAt)
+    {
+        auto captureStart = std::chrono::steady_clock::now();
+        mFirstFrameMs = -1;
+        mFirstPacketMs = -1;
+        if (fps <= 0)
+            fps = source.frameRate() > 0 ? source.frameRate() : 30;
+        mCaptureFps = fps;
+
+        // Make sure dimensions are even (required for many codecs); the odd
+        // last row/column is dropped rather than grabbing outside the window
+        int width = source.width() & ~1;
+        int height = source.height() & ~1;
+        if (width <= 0 || height <= 0)
         {
-            std::cerr << "Failed to open codec" << std::endl;
-            avcodec_free_context(&codecContext);
-            avformat_free_context(formatContext);
+            std::cerr << "Nothing to record from " << source.name() << " source" << std::endl;
             return;
         }
 
-        // Copy codec parameters to stream
-        avcodec_parameters_from_context(stream->codecpar, codecContext);
+        std::cout << "Recording " << source.name() << " source with size: " << width << "x" << height << std::endl;
 
-        // Open output file
-        if (!(formatContext->oformat->flags & AVFMT_NOFILE))
+        // A missing output dimension follows the captured aspect ratio
+        int outputWidth = mOutputWidth;
+        int outputHeight = mOutputHeight;
+        if (outputWidth <= 0 && outputHeight <= 0)
+        {
+            outputWidth = width;
+            outputHeight = height;
+        }
+        else if (outputWidth <= 0)
+        {
+            outputWidth = static_cast<int>(static_cast<int64_t>(width) * outputHeight / height);
+        }
+        else if (outputHeight <= 0)
         {
-            if (avio_open(&formatContext->pb, ("out/" + filename).c_str(), AVIO_FLAG_WRITE) < 0)
+            outputHeight = static_cast<int>(static_cast<int64_t>(height) * outputWidth / width);
+        }
+        outputWidth = std::max(2, outputWidth & ~1);
+        outputHeight = std::max(2, outputHeight & ~1);
+        if (outputWidth != width || outputHeight != height)
+            std::cout << "Scaling to " << outputWidth << "x" << outputHeight << std::endl;
+
+        // Only sources that run against the clock can fall behind
+        bool paced = source.isRealtime();
+        bool adaptive = paced && mAdaptiveQuality;
+        LoadController controller(fps);
+
+        video_encoder::EncoderSettings settings;
+        settings.width = outputWidth;
+        settings.height = outputHeight;
+        settings.fps = fps;
+        settings.adaptive = adaptive;
+        if (adaptive)
+            settings.preset = controller.level().preset;
+
+        // The file is one sink among any others that were added; without a
+        // filename only those and the callbacks see the encoded stream
+        PacketFanout fanout;
+        if (!filename.empty())
+        {
+            std::filesystem::path outputDir = "out";
+            if (!std::filesystem::exists(outputDir))
             {
-                std::cerr << "Failed to open output file" << std::endl;
-                avcodec_free_context(&codecContext);
-                avformat_free_context(formatContext);
-                return;
+                std::filesystem::create_directories(outputDir);
+                std::cout << "Created output directory: " << outputDir << std::endl;
             }
+            // The recording itself never drops packets
+            fanout.addSink(std::make_shared<MuxerSink>("out/" + filename, "", true), true);
+            settings.globalHeader = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mCallbackMutex);
+            for (const auto &sink : mPacketSinks)
+                fanout.addSink(sink);
         }
 
-        // Write header
-        if (avformat_write_header(formatContext, nullptr) < 0)
+        using Ms = std::chrono::duration<double, std::milli>;
+        video_encoder::VideoEncoder encoder;
+        encoder.setPacketCallback([this, &fanout, requestedAt](const AVPacket *packet, int timeBaseNum, int timeBaseDen)
+                                  {
+                                      if (mFirstPacketMs < 0)
+                                      {
+                                          mFirstPacketMs = Ms(std::chrono::steady_clock::now() - requestedAt).count();
+                                          std::cout << "First packet encoded " << mFirstPacketMs << " ms after start" << std::endl;
+                                      }
+                                      publishPacket(packet, timeBaseNum, timeBaseDen);
+                                      fanout.push(packet);
+                                  });
+
+        std::string tracePath;
         {
-            std::cerr << "Failed to write header" << std::endl;
-            return;
+            std::lock_guard<std::mutex> lock(mCallbackMutex);
+            tracePath = mTracePath;
+        }
+        if (!tracePath.empty())
+        {
+            if (FrameTracer::start())
+            {
+                std::cout << "Tracing frames to " << tracePath << std::endl;
+            }
+            else
+            {
+                std::cerr << "Another recording in this process is being traced, not tracing to " << tracePath << std::endl;
+                tracePath.clear();
+            }
         }
+        FrameTracer::setThreadName("capture");
+
+        // Opening the codec (x264 starts its threads and lookahead) runs
+        // while the first frames are grabbed. They are converted into their
+        // own buffers and encoded in order once it is ready; the muxer header
+        // is then written on the sink thread while encoding goes on.
+        std::future<bool> encoderOpening = std::async(std::launch::async, [&encoder, settings]()
+                                                      {
+                                                          FrameTracer::setThreadName("encoder open");
+                                                          TraceSpan span("open encoder");
+                                                          return encoder.initialize("", settings);
+                                                      });
+        bool encoderOpen = false;
+        std::deque<AVFrame *> earlyFrames;
+        // Returns false if the encoder failed to open. Without `wait` it only
+        // picks up an encoder that has finished opening.
+        auto finishEncoderOpen = [&](bool wait) -> bool
+        {
+            if (encoderOpen)
+                return true;
+            if (!wait && encoderOpening.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return true;
+            if (!encoderOpening.get())
+                return false;
+            encoderOpen = true;
+            fanout.start(encoder.codecContext());
+            std::cout << "Encoder ready " << Ms(std::chrono::steady_clock::now() - captureStart).count()
+                      << " ms into the recording, " << earlyFrames.size() << " frame(s) were buffered" << std::endl;
+            for (AVFrame *early : earlyFrames)
+            {
+                TraceSpan span("encode", early->pts);
+                encoder.encodeFrame(early);
+                av_frame_free(&early);
+            }
+            earlyFrames.clear();
+            return true;
+        };
 
-        // Allocate frame
-        AVFrame *frame = av_frame_alloc();
-        frame->format = codecContext->pix_fmt;
-        frame->width = width;
-        frame->height = height;
-        av_frame_get_buffer(frame, 0);
+        AVFrame *frame = allocateFrame(outputWidth, outputHeight);
 
-        // Create software scaler context for RGB to YUV conversion
-        SwsContext *swsContext = sws_getContext(
-            width, height, AV_PIX_FMT_RGB24,
-            width, height, AV_PIX_FMT_YUV420P,
-            SWS_BICUBIC, nullptr, nullptr, nullptr);
+        int64_t totalTicks = duration_seconds > 0 ? static_cast<int64_t>(fps) * duration_seconds : 0;
+        auto frameDelay = std::chrono::microseconds(1000000 / fps);
 
-        int totalFrames = fps * duration_seconds;
-        auto frameDelay = std::chrono::milliseconds(1000 / fps);
+        SliceConverter converter(mConversionSlices, outputHeight);
+        std::cout << "Converting on " << converter.sliceCount() << " slice(s)" << std::endl;
 
-        std::cout << "Recording " << totalFrames << " frames at " << fps << " FPS..." << std::endl;
+        if (totalTicks > 0)
+            std::cout << "Recording " << totalTicks << " frames at " << fps << " FPS..." << std::endl;
+        else
+            std::cout << "Recording at " << fps << " FPS until stopped..." << std::endl;
 
-        for (int frameNum = 0; frameNum < totalFrames; frameNum++)
+        std::unique_ptr<ActivityMonitor> activity;
+        if (paced && mTimeLapseFps > 0 && mTimeLapseFps < fps)
         {
-            auto frameStart = std::chrono::steady_clock::now();
+            activity = std::make_unique<ActivityMonitor>(fps, mTimeLapseFps, mDisplay.get());
+            std::cout << "Time-lapse: sampling at " << mTimeLapseFps << " fps while idle" << std::endl;
+        }
 
-            // Capture current frame
-            std::unique_ptr<XImage, ImageDeleter> xImage(
-                XGetImage(mDisplay.get(), windowId, 0, 0, width, height, AllPlanes, ZPixmap));
+        double convertMs = 0;
+        int convertedFrames = 0;
+        auto encodeCaptured = [&](const Frame &captured, int64_t tick, FrameTiming &timing)
+        {
+            // Convert BGRX (libyuv's ARGB byte order) straight to YUV420P,
+            // scaling on the way when the output size differs
+            auto convertStart = std::chrono::steady_clock::now();
+            AVFrame *target = encoderOpen ? frame : allocateFrame(outputWidth, outputHeight);
+            {
+                TraceSpan span("convert", tick);
+                av_frame_make_writable(target);
+                converter.convert(captured.data[0], captured.stride[0], width, height,
+                                  target->data, target->linesize, outputWidth, outputHeight, tick);
+            }
 
-            if (!xImage)
+            target->pts = tick;
             {
-                std::cerr << "Failed to capture frame " << frameNum << std::endl;
-                continue;
+                TraceSpan span("deliver", tick);
+                publishFrame(target, tick);
             }
+            auto convertEnd = std::chrono::steady_clock::now();
 
-            // Convert XImage to RGB buffer
-            std::vector<uint8_t> argb_buffer(width * height * 4);
-            for (int y = 0; y < height; y++)
+            if (encoderOpen)
+            {
+                TraceSpan span("encode", tick);
+                encoder.encodeFrame(frame);
+            }
+            else
+            {
+                earlyFrames.push_back(target);
+            }
+            auto encodeEnd = std::chrono::steady_clock::now();
+
+            timing.convertMs = Ms(convertEnd - convertStart).count();
+            timing.encodeMs = Ms(encodeEnd - convertEnd).count();
+            convertMs += timing.convertMs;
+            convertedFrames++;
+        };
+
+        // Frames are timestamped with the capture tick they belong to, so the
+        // output keeps wall-clock timing even when ticks have to be skipped
+        auto startTime = std::chrono::steady_clock::now();
+        int64_t lastReported = -1;
+        int64_t sampledTick = -1;
+        int64_t encodedTick = -1;
+        uint64_t sampledFrames = 0;
+        uint64_t encodedFrames = 0;
+        // Time-lapse leaves out unchanged frames; the last one still closes the file
+        std::shared_ptr<const Frame> unencoded;
+        bool encoderFailed = false;
+        for (int64_t tick = 0; (totalTicks == 0 || tick < totalTicks) && !mStopRequested;)
+        {
+            FrameTiming timing;
+            if (paced)
             {
-                for (int x = 0; x < width; x++)
+                auto due = startTime + tick * frameDelay;
+                auto now = std::chrono::steady_clock::now();
+                if (now < due)
                 {
-                    unsigned long pixel = XGetPixel(xImage.get(), x, y);
-
-                    int idx = (y * width + x) * 4;
-                    argb_buffer[idx + 0] = (pixel & 0x00FF0000) >> 16; // B
-                    argb_buffer[idx + 1] = (pixel & 0x0000FF00) >> 8;  // G
-                    argb_buffer[idx + 2] = (pixel & 0x000000FF);       // R
-                    argb_buffer[idx + 3] = 255;                        // A
+                    TraceSpan span("wait", tick);
+                    if (!activity)
+                    {
+                        std::this_thread::sleep_until(due);
+                    }
+                    else if (activity->waitUntil(due))
+                    {
+                        // Input while idling: sample right away
+                        int64_t elapsed = (std::chrono::steady_clock::now() - startTime) / frameDelay;
+                        tick = std::max(sampledTick + 1, elapsed);
+                    }
+                }
+                else
+                {
+                    // Behind schedule: drop the ticks that are already gone
+                    int64_t late = (now - due) / frameDelay;
+                    timing.lateFrames = static_cast<int>(late);
+                    tick += late;
+                    if (totalTicks > 0 && tick >= totalTicks)
+                        break;
                 }
             }
 
-            // Convert ARGB to RGB using libyuv
-            std::vector<uint8_t> rgb_buffer(width * height * 3);
-            libyuv::ARGBToRGB24(
-                argb_buffer.data(), width * 4,
-                rgb_buffer.data(), width * 3,
-                width, height);
-
-            // Convert RGB to YUV420P using FFmpeg's swscale
-            const uint8_t *rgb_data[1] = {rgb_buffer.data()};
-            int rgb_linesize[1] = {width * 3};
-
-            sws_scale(swsContext, rgb_data, rgb_linesize, 0, height,
-                      frame->data, frame->linesize);
-
-            frame->pts = frameNum;
-
-            // Encode frame
-            AVPacket *packet = av_packet_alloc();
+            // Capture current frame
+            auto stageStart = std::chrono::steady_clock::now();
+            std::shared_ptr<const Frame> captured;
+            {
+                TraceSpan span("grab", tick);
+                captured = source.grab(tick);
+            }
 
-            int ret = avcodec_send_frame(codecContext, frame);
-            if (ret < 0)
+            if (!captured || captured->width < width || captured->height < height)
             {
-                std::cerr << "Error sending frame to encoder" << std::endl;
+                if (source.atEnd())
+                    break;
+                std::cerr << "Failed to capture frame " << tick << std::endl;
+                tick++;
                 continue;
             }
 
-            while (ret >= 0)
             {
-                ret = avcodec_receive_packet(codecContext, packet);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                    break;
-                else if (ret < 0)
+                TraceSpan span("deliver", tick);
+                deliverFrame(captured);
+            }
+            timing.grabMs = Ms(std::chrono::steady_clock::now() - stageStart).count();
+            if (mFirstFrameMs < 0)
+            {
+                mFirstFrameMs = Ms(std::chrono::steady_clock::now() - requestedAt).count();
+                std::cout << "First frame captured " << mFirstFrameMs << " ms after start ("
+                          << Ms(std::chrono::steady_clock::now() - captureStart).count() << " ms into the recording)" << std::endl;
+            }
+            sampledTick = tick;
+            sampledFrames++;
+
+            // An unchanged frame still goes out now and then, so that network
+            // sinks and readers joining late get a picture during long idle spells
+            bool stale = encodedTick < 0 || tick - encodedTick >= static_cast<int64_t>(fps) * kTimeLapseKeepAliveSeconds;
+            bool changed = true;
+            if (activity)
+            {
+                TraceSpan span("compare", tick);
+                changed = activity->sample(*captured);
+            }
+            if (!changed && !stale)
+            {
+                unencoded = captured;
+            }
+            else
+            {
+                // Only waits for the encoder once the early frames fill up
+                if (!finishEncoderOpen(earlyFrames.size() >= kMaxEarlyFrames))
                 {
-                    std::cerr << "Error during encoding" << std::endl;
+                    encoderFailed = true;
                     break;
                 }
-
-                av_packet_rescale_ts(packet, codecContext->time_base, stream->time_base);
-                packet->stream_index = stream->index;
-
-                av_interleaved_write_frame(formatContext, packet);
-                av_packet_unref(packet);
+                unencoded.reset();
+                encodeCaptured(*captured, tick, timing);
+                encodedTick = tick;
+                encodedFrames++;
             }
 
-            if (frameNum % fps == 0) // Print progress every second
+            if (tick / fps != lastReported) // Print progress every second
             {
-                std::cout << "Recorded " << frameNum << "/" << totalFrames << " frames" << std::endl;
+                lastReported = tick / fps;
+                if (totalTicks > 0)
+                    std::cout << "Recorded " << tick << "/" << totalTicks << " frames";
+                else
+                    std::cout << "Recorded " << tick << " frames";
+                if (activity)
+                    std::cout << " (" << encodedFrames << " encoded)";
+                if (convertedFrames > 0)
+                    std::cout << " (convert " << convertMs / convertedFrames << " ms/frame on "
+                              << converter.sliceCount() << " slice(s))";
+                std::cout << std::endl;
+                convertMs = 0;
+                convertedFrames = 0;
             }
 
-            // Maintain frame rate
-            auto frameEnd = std::chrono::steady_clock::now();
-            auto elapsed = frameEnd - frameStart;
-            if (elapsed < frameDelay)
+            if (adaptive && encoderOpen)
             {
-                std::this_thread::sleep_for(frameDelay - elapsed);
+                if (controller.update(timing) && controller.level().preset != encoder.settings().preset)
+                    encoder.reconfigure(controller.level().preset);
             }
+            int step = adaptive ? controller.level().fpsDivisor : 1;
+            if (activity)
+                step = std::max(step, activity->tickStep());
+            tick += step;
         }
 
-        // Flush encoder
-        avcodec_send_frame(codecContext, nullptr);
-        AVPacket *packet = av_packet_alloc();
-        while (avcodec_receive_packet(codecContext, packet) == 0)
+        if (!encoderFailed && !finishEncoderOpen(true))
+            encoderFailed = true;
+        if (encoderFailed)
         {
-            av_packet_rescale_ts(packet, codecContext->time_base, stream->time_base);
-            packet->stream_index = stream->index;
-            av_interleaved_write_frame(formatContext, packet);
-            av_packet_unref(packet);
+            for (AVFrame *early : earlyFrames)
+                av_frame_free(&early);
+            earlyFrames.clear();
+        }
+        else if (unencoded && sampledTick > encodedTick)
+        {
+            FrameTiming timing;
+            encodeCaptured(*unencoded, sampledTick, timing);
+            encodedFrames++;
+        }
+        if (activity)
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            std::cout << "Time-lapse: sampled " << sampledFrames << " and encoded " << encodedFrames << " frames in "
+                      << seconds << " s (" << static_cast<int64_t>(seconds * fps) << " at the full rate)" << std::endl;
         }
 
-        // Write trailer and cleanup
-        av_write_trailer(formatContext);
-
-        sws_freeContext(swsContext);
+        encoder.finalize();
+        fanout.stop();
         av_frame_free(&frame);
-        avcodec_free_context(&codecContext);
-        if (!(formatContext->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&formatContext->pb);
-        avformat_free_context(formatContext);
-
-        std::cout << "Video recording completed: out/" << filename << std::endl;
+        if (!tracePath.empty())
+            FrameTracer::stop(tracePath);
+
+        if (encoderFailed)
+            std::cerr << "Recording aborted, the encoder could not be opened" << std::endl;
+        else if (!filename.empty())
+            std::cout << "Video recording completed: out/" << filename << std::endl;
+        else
+            std::cout << "Video recording completed." << std::endl;
     }
 
     void DesktopCapture::captureThumbnail(Window windowId, const std::string &filename)
     {
         // Start capturing the specified window
         std::cout << "Starting capture for window ID: " << windowId << std::endl;
-        XWindowAttributes attrs;
-        if (XGetWindowAttributes(mDisplay.get(), windowId, &attrs) == 0)
-        {
-            std::cerr << "Failed to get attributes for window ID: " << windowId << std::endl;
+        auto source = createWindowSource(windowId);
+        if (!source)
             return;
-        }
-        mScreenWidth = attrs.width;
-        mScreenHeight = attrs.height;
+        mScreenWidth = source->width();
+        mScreenHeight = source->height();
         std::cout << "Capturing window: " << windowId << " with size: " << mScreenWidth << "x" << mScreenHeight << std::endl;
-        std::unique_ptr<XImage, ImageDeleter> xImage(
-            XGetImage(mDisplay.get(), windowId, 0, 0, mScreenWidth, mScreenHeight, AllPlanes, ZPixmap));
-        if (!xImage)
+        std::shared_ptr<const Frame> captured = source->grab(0);
+        if (!captured)
         {
             std::cerr << "Failed to capture image for window ID: " << windowId << std::endl;
             return;
         }
-        std::vector<uint8_t> argb_buffer(mScreenWidth * mScreenHeight * 4);
-        for (int y = 0; y < mScreenHeight; y++)
-        {
-            for (int x = 0; x < mScreenWidth; x++)
-            {
-                unsigned long pixel = XGetPixel(xImage.get(), x, y);
 
-                int idx = (y * mScreenWidth + x) * 4;
-                argb_buffer[idx + 0] = (pixel & 0x00FF0000) >> 16; // B
-                argb_buffer[idx + 1] = (pixel & 0x0000FF00) >> 8;  // G
-                argb_buffer[idx + 2] = (pixel & 0x000000FF);       // R
-                argb_buffer[idx + 3] = 255;                        // A (fully opaque)
-            }
-        }
-
-        // Convert ARGB to RGB using libyuv
+        // Convert BGRX to RGB using libyuv (RAW is R,G,B in memory)
         std::vector<uint8_t> rgb_buffer(mScreenWidth * mScreenHeight * 3);
-        int result = libyuv::ARGBToRGB24(
-            argb_buffer.data(), mScreenWidth * 4,
+        int result = libyuv::ARGBToRAW(
+            captured->data[0], captured->stride[0],
             rgb_buffer.data(), mScreenWidth * 3,
             mScreenWidth, mScreenHeight);
 
@@ -495,8 +888,15 @@ namespace screen_recorder
     void DesktopCapture::stopCapture()
     {
         // Stop capturing the current window
+        if (!mCaptureThread.joinable() && !mCapturing)
+            return;
         std::cout << "Stopping capture." << std::endl;
-        // Implementation of stopping logic goes here
+        mStopRequested = true;
+        if (mCaptureThread.joinable())
+        {
+            mCaptureThread.join();
+            mStopRequested = false;
+        }
     }
 
 } // namespace screen_recorder
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "frameRing.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t kPageSize = 4096;
+    constexpr uint32_t kRowAlignment = 64;
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    std::string shmName(const std::string &name)
+    {
+        return name.empty() || name[0] == '/' ? name : "/" + name;
+    }
+
+    // Plane geometry of a frame inside a slot payload, rows padded to 64 bytes
+    int planeLayout(screen_recorder::PixelFormat format, int width, int height,
+                    uint32_t stride[3], uint32_t offset[3], int rows[3], int rowBytes[3])
+    {
+        if (format == screen_recorder::PixelFormat::I420)
+        {
+            int chromaWidth = (width + 1) / 2;
+            int chromaHeight = (height + 1) / 2;
+            rowBytes[0] = width;
+            rowBytes[1] = rowBytes[2] = chromaWidth;
+            rows[0] = height;
+            rows[1] = rows[2] = chromaHeight;
+            stride[0] = alignUp(width, kRowAlignment);
+            stride[1] = stride[2] = alignUp(chromaWidth, kRowAlignment);
+            offset[0] = 0;
+            offset[1] = stride[0] * height;
+            offset[2] = offset[1] + stride[1] * chromaHeight;
+            return 3;
+        }
+
+        rowBytes[0] = width * 4;
+        rows[0] = height;
+        stride[0] = alignUp(width * 4, kRowAlignment);
+        offset[0] = 0;
+        return 1;
+    }
+
+    size_t payloadSize(const uint32_t stride[3], const uint32_t offset[3], const int rows[3], int planes)
+    {
+        return offset[planes - 1] + static_cast<size_t>(stride[planes - 1]) * rows[planes - 1];
+    }
+
+    screen_recorder::FrameRingSlot *slotAt(uint8_t *mapping, uint32_t index)
+    {
+        return reinterpret_cast<screen_recorder::FrameRingSlot *>(
+                   mapping + sizeof(screen_recorder::FrameRingHeader)) +
+               index;
+    }
+}
+
+namespace screen_recorder
+{
+    FrameRingWriter::FrameRingWriter(const std::string &name, PixelFormat format, int slotCount)
+        : mName(shmName(name)), mFormat(format), mSlotCount(slotCount > 1 ? slotCount : 2),
+          mFd(-1), mMapping(nullptr), mMappingSize(0), mSequence(0), mEnded(false)
+    {
+        // Claim the name right away; a ring another recorder is still
+        // writing must not be replaced under its readers
+        mFd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (mFd < 0)
+        {
+            if (errno == EEXIST)
+                std::cerr << "Shared memory " << mName << " is already in use (remove /dev/shm" << mName
+                          << " if it was left behind by a crashed recorder)" << std::endl;
+            else
+                std::cerr << "Failed to create shared memory " << mName << ": " << std::strerror(errno) << std::endl;
+            mEnded = true;
+        }
+    }
+
+    FrameRingWriter::~FrameRingWriter()
+    {
+        close();
+    }
+
+    bool FrameRingWriter::create(int width, int height)
+    {
+        uint32_t stride[3], offset[3];
+        int rows[3], rowBytes[3];
+        int planes = planeLayout(mFormat, width, height, stride, offset, rows, rowBytes);
+        size_t slotSize = alignUp(payloadSize(stride, offset, rows, planes), kPageSize);
+        size_t payloadOffset = alignUp(sizeof(FrameRingHeader) + sizeof(FrameRingSlot) * mSlotCount, kPageSize);
+        size_t size = payloadOffset + slotSize * mSlotCount;
+
+        if (ftruncate(mFd, size) != 0)
+        {
+            std::cerr << "Failed to size shared memory " << mName << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            std::cerr << "Failed to map shared memory " << mName << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        mMapping = static_cast<uint8_t *>(mapping);
+        mMappingSize = size;
+
+        // ftruncate zero-fills, so every slot starts out at sequence 0 (empty)
+        auto *header = reinterpret_cast<FrameRingHeader *>(mMapping);
+        header->version = kFrameRingVersion;
+        header->slotCount = mSlotCount;
+        header->slotSize = slotSize;
+        header->payloadOffset = payloadOffset;
+        header->writeSequence.store(0, std::memory_order_relaxed);
+        // Readers check the magic last, so publish it after everything else
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kFrameRingMagic;
+
+        std::cout << "Exporting frames to shared memory " << mName << " (" << mSlotCount << " slots, "
+                  << width << "x" << height << ")" << std::endl;
+        return true;
+    }
+
+    bool FrameRingWriter::publish(const Frame &frame)
+    {
+        if (frame.format != mFormat || mEnded)
+            return false;
+        if (!mMapping && !create(frame.width, frame.height))
+        {
+            mEnded = true;
+            return false;
+        }
+
+        auto *header = reinterpret_cast<FrameRingHeader *>(mMapping);
+        uint32_t stride[3], offset[3];
+        int rows[3], rowBytes[3];
+        int planes = planeLayout(mFormat, frame.width, frame.height, stride, offset, rows, rowBytes);
+        if (payloadSize(stride, offset, rows, planes) > header->slotSize)
+        {
+            // Readers have the old size mapped, so the ring cannot grow
+            std::cerr << "Frame " << frame.index << " (" << frame.width << "x" << frame.height
+                      << ") does not fit the shared memory ring, ending the export" << std::endl;
+            close();
+            return false;
+        }
+
+        uint64_t sequence = ++mSequence;
+        FrameRingSlot *slot = slotAt(mMapping, (sequence - 1) % mSlotCount);
+        uint8_t *payload = mMapping + header->payloadOffset + ((sequence - 1) % mSlotCount) * header->slotSize;
+
+        // Odd sequence marks the slot as being rewritten for anyone still reading it
+        slot->sequence.store(sequence * 2 - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->frameIndex = frame.index;
+        slot->timestampUs = frame.timestampUs;
+        slot->width = frame.width;
+        slot->height = frame.height;
+        slot->format = static_cast<uint32_t>(frame.format);
+        for (int plane = 0; plane < 3; plane++)
+        {
+            slot->stride[plane] = plane < planes ? stride[plane] : 0;
+            slot->offset[plane] = plane < planes ? offset[plane] : 0;
+        }
+        for (int plane = 0; plane < planes; plane++)
+        {
+            const uint8_t *src = frame.data[plane];
+            uint8_t *dst = payload + offset[plane];
+            for (int y = 0; y < rows[plane]; y++)
+            {
+                std::memcpy(dst + static_cast<size_t>(y) * stride[plane],
+                            src + static_cast<size_t>(y) * frame.stride[plane], rowBytes[plane]);
+            }
+        }
+
+        slot->sequence.store(sequence * 2, std::memory_order_release);
+        header->writeSequence.store(sequence, std::memory_order_release);
+        return true;
+    }
+
+    void FrameRingWriter::close()
+    {
+        if (mMapping)
+        {
+            munmap(mMapping, mMappingSize);
+            mMapping = nullptr;
+            mMappingSize = 0;
+        }
+        if (mFd >= 0)
+        {
+            // Only unlink the name while it still refers to our segment
+            struct stat own, named;
+            int fd = shm_open(mName.c_str(), O_RDONLY, 0);
+            if (fd >= 0)
+            {
+                if (fstat(mFd, &own) == 0 && fstat(fd, &named) == 0 &&
+                    own.st_dev == named.st_dev && own.st_ino == named.st_ino)
+                    shm_unlink(mName.c_str());
+                ::close(fd);
+            }
+            ::close(mFd);
+            mFd = -1;
+        }
+        mEnded = true;
+    }
+
+    FrameRingReader::FrameRingReader()
+        : mFd(-1), mMapping(nullptr), mMappingSize(0)
+    {
+    }
+
+    FrameRingReader::~FrameRingReader()
+    {
+        close();
+    }
+
+    bool FrameRingReader::open(const std::string &name)
+    {
+        close();
+        std::string path = shmName(name);
+        mFd = shm_open(path.c_str(), O_RDONLY, 0);
+        if (mFd < 0)
+        {
+            std::cerr << "Failed to open shared memory " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(mFd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FrameRingHeader))
+        {
+            std::cerr << "Shared memory " << path << " is not a frame ring" << std::endl;
+            close();
+            return false;
+        }
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, mFd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            std::cerr << "Failed to map shared memory " << path << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        mMapping = static_cast<uint8_t *>(mapping);
+        mMappingSize = info.st_size;
+
+        const auto *header = reinterpret_cast<const FrameRingHeader *>(mMapping);
+        if (header->magic != kFrameRingMagic || header->version != kFrameRingVersion)
+        {
+            std::cerr << "Shared memory " << path << " is not a compatible frame ring" << std::endl;
+            close();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    void FrameRingReader::close()
+    {
+        if (mMapping)
+        {
+            munmap(mMapping, mMappingSize);
+            mMapping = nullptr;
+            mMappingSize = 0;
+        }
+        if (mFd >= 0)
+        {
+            ::close(mFd);
+            mFd = -1;
+        }
+    }
+
+    bool FrameRingReader::acquireLatest(FrameRingView &view, uint64_t afterSequence) const
+    {
+        if (!mMapping)
+            return false;
+
+        auto *header = reinterpret_cast<FrameRingHeader *>(mMapping);
+        uint64_t sequence = header->writeSequence.load(std::memory_order_acquire);
+        if (sequence == 0 || sequence <= afterSequence)
+            return false;
+
+        uint32_t index = (sequence - 1) % header->slotCount;
+        FrameRingSlot *slot = slotAt(mMapping, index);
+        if (slot->sequence.load(std::memory_order_acquire) != sequence * 2)
+            return false; // already being overwritten, the caller just retries
+
+        const uint8_t *payload = mMapping + header->payloadOffset + index * header->slotSize;
+        view.sequence = sequence;
+        view.frame = Frame();
+        view.frame.width = slot->width;
+        view.frame.height = slot->height;
+        view.frame.format = static_cast<PixelFormat>(slot->format);
+        for (int plane = 0; plane < 3; plane++)
+        {
+            view.frame.data[plane] = slot->stride[plane] ? payload + slot->offset[plane] : nullptr;
+            view.frame.stride[plane] = slot->stride[plane];
+        }
+        view.frame.timestampUs = slot->timestampUs;
+        view.frame.index = slot->frameIndex;
+        return isValid(view);
+    }
+
+    bool FrameRingReader::isValid(const FrameRingView &view) const
+    {
+        if (!mMapping || view.sequence == 0)
+            return false;
+        auto *header = reinterpret_cast<FrameRingHeader *>(mMapping);
+        FrameRingSlot *slot = slotAt(mMapping, (view.sequence - 1) % header->slotCount);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot->sequence.load(std::memory_order_relaxed) == view.sequence * 2;
+    }
+}
@@ -0,0 +1,309 @@
+#include "frameSource.h"
+#include "desktopCapturer.h"
+#include "pixelUnpack.h"
+#include "syntheticSource.h"
+#include "replaySource.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+namespace screen_recorder
+{
+    int64_t steadyClockMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    std::shared_ptr<const Frame> frameFromXImage(const std::shared_ptr<XImage> &image, const pixel_unpack::Unpacker &unpacker,
+                                                 int width, int height, uint64_t index)
+    {
+        auto frame = std::make_shared<Frame>();
+        frame->width = width;
+        frame->height = height;
+        frame->format = PixelFormat::BGRX;
+        frame->timestampUs = steadyClockMicros();
+        frame->index = index;
+
+        if (unpacker.native)
+        {
+            // Hand out the XImage memory itself; the frame shares ownership
+            frame->data[0] = reinterpret_cast<const uint8_t *>(image->data);
+            frame->stride[0] = image->bytes_per_line;
+            frame->owner = image;
+            return frame;
+        }
+
+        auto buffer = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(width) * height * 4);
+        if (unpacker.unpack)
+            unpacker.unpack(reinterpret_cast<const uint8_t *>(image->data), image->bytes_per_line,
+                            buffer->data(), width * 4, width, height);
+        else
+            pixel_unpack::genericUnpack(image.get(), buffer->data(), width * 4, width, height);
+        frame->data[0] = buffer->data();
+        frame->stride[0] = width * 4;
+        frame->owner = buffer;
+        return frame;
+    }
+
+    XGetImageSource::XGetImageSource(Display *display, Drawable drawable, int x, int y, int width, int height,
+                                     Visual *visual, int depth)
+        : mDisplay(display), mDrawable(drawable), mX(x), mY(y), mWidth(width), mHeight(height),
+          mVisual(visual), mDepth(depth), mUnpackerSelected(false)
+    {
+    }
+
+    std::shared_ptr<const Frame> XGetImageSource::grab(uint64_t index)
+    {
+        std::shared_ptr<XImage> image(
+            XGetImage(mDisplay, mDrawable, mX, mY, mWidth, mHeight, AllPlanes, ZPixmap), ImageDeleter());
+        if (!image)
+            return nullptr;
+        if (mVisual && (mDepth == 0 || image->depth == mDepth))
+        {
+            // XGetImage leaves the masks of a pixmap's image at 0
+            image->red_mask = mVisual->red_mask;
+            image->green_mask = mVisual->green_mask;
+            image->blue_mask = mVisual->blue_mask;
+        }
+        if (!mUnpackerSelected)
+        {
+            // The layout of a drawable's images never changes, choose once
+            mUnpacker = pixel_unpack::selectUnpacker(image.get());
+            mUnpackerSelected = true;
+            std::cout << "Capture pixel format: " << mUnpacker.name << std::endl;
+        }
+        return frameFromXImage(image, mUnpacker, mWidth, mHeight, index);
+    }
+
+#ifdef HAVE_XSHM
+    namespace
+    {
+        bool gShmAttachFailed = false;
+
+        int shmErrorHandler(Display *, XErrorEvent *)
+        {
+            gShmAttachFailed = true;
+            return 0;
+        }
+    }
+
+    struct XShmSource::Segment
+    {
+        Display *display = nullptr;
+        XShmSegmentInfo info{};
+        XImage *image = nullptr;
+        bool attached = false;
+
+        ~Segment()
+        {
+            if (attached)
+                XShmDetach(display, &info);
+            if (image)
+                XDestroyImage(image);
+            if (info.shmaddr && info.shmaddr != reinterpret_cast<char *>(-1))
+                shmdt(info.shmaddr);
+        }
+    };
+
+    // Segments still referenced by a frame are left alone; four is enough for
+    // the capture loop plus a couple of consumers holding on to frames.
+    constexpr size_t kMaxShmSegments = 4;
+
+    XShmSource::XShmSource(Display *display, Drawable drawable, int x, int y, int width, int height, Visual *visual, int depth)
+        : mDisplay(display), mDrawable(drawable), mX(x), mY(y), mWidth(width), mHeight(height),
+          mVisual(DefaultVisual(display, DefaultScreen(display))), mDepth(DefaultDepth(display, DefaultScreen(display))),
+          mFallback(display, drawable, x, y, width, height, visual, depth)
+    {
+        // The image has to match the window's own visual (e.g. 32-bit ARGB windows)
+        XWindowAttributes attrs;
+        if (visual)
+        {
+            mVisual = visual;
+            mDepth = depth;
+        }
+        else if (XGetWindowAttributes(display, drawable, &attrs))
+        {
+            mVisual = attrs.visual;
+            mDepth = attrs.depth;
+        }
+    }
+
+    XShmSource::~XShmSource()
+    {
+        mSegments.clear();
+    }
+
+    bool XShmSource::isSupported(Display *display)
+    {
+        return XShmQueryExtension(display);
+    }
+
+    std::shared_ptr<XShmSource::Segment> XShmSource::acquireSegment()
+    {
+        for (auto &segment : mSegments)
+        {
+            if (segment.use_count() == 1)
+                return segment;
+        }
+        if (mSegments.size() >= kMaxShmSegments)
+            return nullptr;
+
+        // Any failure from here on means SHM is unusable for this display
+        mShmFailed = true;
+        auto segment = std::make_shared<Segment>();
+        segment->display = mDisplay;
+        segment->image = XShmCreateImage(mDisplay, mVisual, mDepth, ZPixmap, nullptr, &segment->info, mWidth, mHeight);
+        if (!segment->image)
+            return nullptr;
+
+        segment->info.shmid = shmget(IPC_PRIVATE, segment->image->bytes_per_line * segment->image->height,
+                                     IPC_CREAT | 0600);
+        if (segment->info.shmid < 0)
+            return nullptr;
+        segment->info.shmaddr = segment->image->data = static_cast<char *>(shmat(segment->info.shmid, nullptr, 0));
+        // Mark for removal right away; it stays alive until the last detach
+        shmctl(segment->info.shmid, IPC_RMID, nullptr);
+        if (segment->info.shmaddr == reinterpret_cast<char *>(-1))
+        {
+            segment->image->data = nullptr;
+            return nullptr;
+        }
+        segment->info.readOnly = False;
+
+        // XShmAttach only fails asynchronously (e.g. remote displays)
+        gShmAttachFailed = false;
+        auto previousHandler = XSetErrorHandler(shmErrorHandler);
+        XShmAttach(mDisplay, &segment->info);
+        XSync(mDisplay, False);
+        XSetErrorHandler(previousHandler);
+        if (gShmAttachFailed)
+        {
+            std::cerr << "XShmAttach failed, falling back to XGetImage" << std::endl;
+            return nullptr;
+        }
+        segment->attached = true;
+
+        if (mSegments.empty())
+        {
+            mUnpacker = pixel_unpack::selectUnpacker(segment->image);
+            std::cout << "Capture pixel format: " << mUnpacker.name << " (MIT-SHM)" << std::endl;
+        }
+        mShmFailed = false;
+        mSegments.push_back(segment);
+        return segment;
+    }
+
+    std::shared_ptr<const Frame> XShmSource::grab(uint64_t index)
+    {
+        auto segment = mShmFailed ? nullptr : acquireSegment();
+        if (!segment)
+            return mFallback.grab(index);
+
+        if (!XShmGetImage(mDisplay, mDrawable, segment->image, mX, mY, AllPlanes))
+            return nullptr;
+
+        // The segment is the owner either way: zero copy for native BGRX,
+        // otherwise it only has to live until the unpacker has run
+        std::shared_ptr<XImage> image(segment, segment->image);
+        return frameFromXImage(image, mUnpacker, mWidth, mHeight, index);
+    }
+#else
+    struct XShmSource::Segment
+    {
+    };
+
+    XShmSource::XShmSource(Display *display, Drawable drawable, int x, int y, int width, int height, Visual *visual, int depth)
+        : mDisplay(display), mDrawable(drawable), mX(x), mY(y), mWidth(width), mHeight(height),
+          mVisual(visual), mDepth(depth), mFallback(display, drawable, x, y, width, height, visual, depth)
+    {
+    }
+
+    XShmSource::~XShmSource() = default;
+
+    bool XShmSource::isSupported(Display *)
+    {
+        return false;
+    }
+
+    std::shared_ptr<XShmSource::Segment> XShmSource::acquireSegment()
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<const Frame> XShmSource::grab(uint64_t index)
+    {
+        return mFallback.grab(index);
+    }
+#endif
+
+    std::unique_ptr<FrameSource> createXSource(Display *display, Drawable drawable, int x, int y, int width, int height,
+                                               Visual *visual, int depth)
+    {
+        if (XShmSource::isSupported(display))
+            return std::make_unique<XShmSource>(display, drawable, x, y, width, height, visual, depth);
+        return std::make_unique<XGetImageSource>(display, drawable, x, y, width, height, visual, depth);
+    }
+
+    CroppedSource::CroppedSource(std::unique_ptr<FrameSource> source, const CaptureRegion &region)
+        : mSource(std::move(source)), mRegion()
+    {
+        mRegion.x = std::clamp(region.x, 0, mSource->width());
+        mRegion.y = std::clamp(region.y, 0, mSource->height());
+        mRegion.width = std::min(region.width, mSource->width() - mRegion.x);
+        mRegion.height = std::min(region.height, mSource->height() - mRegion.y);
+    }
+
+    std::shared_ptr<const Frame> CroppedSource::grab(uint64_t index)
+    {
+        std::shared_ptr<const Frame> frame = mSource->grab(index);
+        if (!frame || frame->format != PixelFormat::BGRX ||
+            frame->width < mRegion.x + mRegion.width || frame->height < mRegion.y + mRegion.height)
+            return nullptr;
+
+        // Same pixels, shifted start; the view keeps the whole frame alive
+        auto view = std::make_shared<Frame>(*frame);
+        view->width = mRegion.width;
+        view->height = mRegion.height;
+        view->data[0] = frame->data[0] + static_cast<size_t>(mRegion.y) * frame->stride[0] + mRegion.x * 4;
+        view->owner = frame;
+        return view;
+    }
+
+    std::unique_ptr<FrameSource> createSourceFromSpec(const std::string &spec, int fps)
+    {
+        if (spec.rfind("replay:", 0) == 0)
+        {
+            auto replay = std::make_unique<ReplaySource>(spec.substr(7));
+            if (!replay->isOpen())
+                return nullptr;
+            return replay;
+        }
+        if (spec.rfind("synthetic:", 0) == 0)
+        {
+            std::string rest = spec.substr(10);
+            size_t colon = rest.find(':');
+            SyntheticPattern pattern;
+            int width = 0, height = 0, rate = fps;
+            if (colon == std::string::npos || !parseSyntheticPattern(rest.substr(0, colon), pattern) ||
+                std::sscanf(rest.c_str() + colon + 1, "%dx%d@%d", &width, &height, &rate) < 2 ||
+                width <= 0 || height <= 0)
+            {
+                std::cerr << "Invalid synthetic source: " << spec << std::endl;
+                return nullptr;
+            }
+            return std::make_unique<SyntheticSource>(pattern, width, height, rate);
+        }
+        std::cerr << "Unknown source: " << spec << std::endl;
+        return nullptr;
+    }
+}
@@ -0,0 +1,220 @@
+#include "frameTracer.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t kChunkEvents = 4096;
+    // 64 MB per thread at most, hours of a busy capture thread at 60 fps
+    constexpr size_t kMaxChunks = 512;
+
+    struct Event
+    {
+        const char *name;
+        int64_t frame;
+        int64_t beginNs;
+        int64_t endNs;
+    };
+
+    struct Chunk
+    {
+        Event events[kChunkEvents];
+        std::atomic<size_t> count{0};
+        std::atomic<Chunk *> next{nullptr};
+    };
+
+    // Only its own thread appends; a reader sees what the counts have
+    // published, so it can dump while the thread is still recording
+    struct ThreadBuffer
+    {
+        int id = 0;
+        std::string name; // guarded by gMutex
+        Chunk head;
+        Chunk *tail = &head;
+        size_t chunks = 1;
+        std::atomic<uint64_t> dropped{0};
+
+        ~ThreadBuffer()
+        {
+            Chunk *chunk = head.next.load();
+            while (chunk)
+            {
+                Chunk *next = chunk->next.load();
+                delete chunk;
+                chunk = next;
+            }
+        }
+    };
+
+    std::mutex gMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> gBuffers;
+    uint64_t gGeneration = 0; // bumped per session so threads register again
+    std::atomic<uint64_t> gCurrentGeneration{0};
+    int64_t gStartNs = 0;
+    int gNextThreadId = 1;
+    bool gSessionOpen = false; // one session at a time per process
+
+    thread_local std::shared_ptr<ThreadBuffer> tBuffer;
+    thread_local uint64_t tGeneration = 0;
+    thread_local std::string tThreadName;
+
+    ThreadBuffer &threadBuffer()
+    {
+        if (tBuffer && tGeneration == gCurrentGeneration.load(std::memory_order_acquire))
+            return *tBuffer;
+
+        auto buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(gMutex);
+        buffer->id = gNextThreadId++;
+        buffer->name = tThreadName.empty() ? "thread " + std::to_string(buffer->id) : tThreadName;
+        gBuffers.push_back(buffer);
+        tBuffer = buffer;
+        tGeneration = gGeneration;
+        return *tBuffer;
+    }
+
+    std::string jsonEscape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+}
+
+namespace screen_recorder
+{
+    std::atomic<bool> FrameTracer::sEnabled{false};
+
+    bool FrameTracer::start()
+    {
+        {
+            std::lock_guard<std::mutex> lock(gMutex);
+            if (gSessionOpen)
+                return false;
+            gSessionOpen = true;
+            gBuffers.clear();
+            gNextThreadId = 1;
+            gStartNs = nowNs();
+            gCurrentGeneration.store(++gGeneration, std::memory_order_release);
+        }
+        sEnabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool FrameTracer::stop(const std::string &path)
+    {
+        // Late spans of threads still running land in buffers we no longer
+        // read past their published counts; the next session starts afresh
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        int64_t startNs;
+        {
+            std::lock_guard<std::mutex> lock(gMutex);
+            if (!gSessionOpen)
+                return false;
+            gSessionOpen = false;
+            sEnabled.store(false, std::memory_order_release);
+            buffers.swap(gBuffers);
+            startNs = gStartNs;
+            gCurrentGeneration.store(++gGeneration, std::memory_order_release);
+        }
+
+        FILE *file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cerr << "Failed to open trace file " << path << std::endl;
+            return false;
+        }
+
+        int pid = static_cast<int>(getpid());
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"ScreenRecorder\"}}", pid);
+
+        size_t events = 0;
+        uint64_t dropped = 0;
+        for (const auto &buffer : buffers)
+        {
+            std::string name;
+            {
+                std::lock_guard<std::mutex> lock(gMutex);
+                name = buffer->name;
+            }
+            std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                         pid, buffer->id, jsonEscape(name).c_str());
+
+            for (const Chunk *chunk = &buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+            {
+                size_t count = chunk->count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < count; i++)
+                {
+                    const Event &event = chunk->events[i];
+                    // Complete events: one record per span, times in microseconds
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                                 event.name, pid, buffer->id, (event.beginNs - startNs) / 1000.0,
+                                 (event.endNs - event.beginNs) / 1000.0);
+                    if (event.frame >= 0)
+                        std::fprintf(file, ",\"args\":{\"frame\":%lld}", static_cast<long long>(event.frame));
+                    std::fputc('}', file);
+                }
+                events += count;
+            }
+            dropped += buffer->dropped.load();
+        }
+        std::fprintf(file, "\n]}\n");
+        bool ok = std::fclose(file) == 0;
+
+        std::cout << "Wrote " << events << " trace events from " << buffers.size() << " threads to " << path << std::endl;
+        if (dropped > 0)
+            std::cerr << "Trace buffers were full, " << dropped << " events were dropped" << std::endl;
+        return ok;
+    }
+
+    void FrameTracer::setThreadName(const std::string &name)
+    {
+        tThreadName = name;
+        if (tBuffer)
+        {
+            std::lock_guard<std::mutex> lock(gMutex);
+            tBuffer->name = name;
+        }
+    }
+
+    void FrameTracer::record(const char *name, int64_t frame, int64_t beginNs, int64_t endNs)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        Chunk *chunk = buffer.tail;
+        size_t count = chunk->count.load(std::memory_order_relaxed);
+        if (count == kChunkEvents)
+        {
+            if (buffer.chunks == kMaxChunks)
+            {
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            chunk = new Chunk;
+            buffer.tail->next.store(chunk, std::memory_order_release);
+            buffer.tail = chunk;
+            buffer.chunks++;
+            count = 0;
+        }
+        chunk->events[count] = {name, frame, beginNs, endNs};
+        chunk->count.store(count + 1, std::memory_order_release);
+    }
+
+    int64_t FrameTracer::nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+}
@@ -0,0 +1,110 @@
+#include "keyframeIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace screen_recorder
+{
+    std::string keyframeIndexPath(const std::string &recordingPath)
+    {
+        return recordingPath + ".idx";
+    }
+
+    KeyframeIndexWriter::KeyframeIndexWriter()
+        : mFile(nullptr)
+    {
+    }
+
+    KeyframeIndexWriter::~KeyframeIndexWriter()
+    {
+        close();
+    }
+
+    bool KeyframeIndexWriter::open(const std::string &path, int timeBaseNum, int timeBaseDen)
+    {
+        close();
+        mFile = fopen(path.c_str(), "wb");
+        if (!mFile)
+        {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+
+        KeyframeIndexHeader header{};
+        std::memcpy(header.magic, kKeyframeIndexMagic, sizeof(header.magic));
+        header.timeBaseNum = timeBaseNum;
+        header.timeBaseDen = timeBaseDen;
+        if (fwrite(&header, sizeof(header), 1, mFile) != 1 || fflush(mFile) != 0)
+        {
+            std::cerr << "Failed to write keyframe index header: " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool KeyframeIndexWriter::append(int64_t pts, int64_t dts, int64_t byteOffset, uint32_t segment)
+    {
+        if (!mFile)
+            return false;
+
+        KeyframeIndexEntry entry{pts, dts, byteOffset, segment, 0};
+        // One small write per keyframe, flushed so readers and crash
+        // recovery see it right away
+        if (fwrite(&entry, sizeof(entry), 1, mFile) != 1 || fflush(mFile) != 0)
+        {
+            std::cerr << "Failed to write keyframe index entry" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void KeyframeIndexWriter::close()
+    {
+        if (!mFile)
+            return;
+        fclose(mFile);
+        mFile = nullptr;
+    }
+
+    bool KeyframeIndex::load(const std::string &path)
+    {
+        mEntries.clear();
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        bool valid = fread(&mHeader, sizeof(mHeader), 1, file) == 1 &&
+                     std::memcmp(mHeader.magic, kKeyframeIndexMagic, sizeof(mHeader.magic)) == 0 &&
+                     mHeader.timeBaseNum > 0 && mHeader.timeBaseDen > 0;
+        if (valid)
+        {
+            // A torn last entry from an interrupted recording is ignored
+            KeyframeIndexEntry entry;
+            while (fread(&entry, sizeof(entry), 1, file) == 1)
+                mEntries.push_back(entry);
+        }
+        fclose(file);
+
+        if (!valid)
+        {
+            std::cerr << "Not a keyframe index: " << path << std::endl;
+            return false;
+        }
+
+        // Muxing order is dts order; with B-frames that still leaves
+        // keyframes in pts order, but don't rely on it for lookups
+        std::sort(mEntries.begin(), mEntries.end(), [](const KeyframeIndexEntry &a, const KeyframeIndexEntry &b)
+                  { return a.pts < b.pts; });
+        return true;
+    }
+
+    const KeyframeIndexEntry *KeyframeIndex::findAtOrBefore(int64_t pts) const
+    {
+        auto next = std::upper_bound(mEntries.begin(), mEntries.end(), pts, [](int64_t value, const KeyframeIndexEntry &entry)
+                                     { return value < entry.pts; });
+        if (next == mEntries.begin())
+            return nullptr;
+        return &*(next - 1);
+    }
+}
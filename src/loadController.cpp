@@ -0,0 +1,104 @@
+#include "loadController.h"
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    // Cheapest last. Presets go first since dropping frames is the more
+    // visible degradation; scale is not on the ladder because the output
+    // stream cannot change resolution mid-file.
+    const screen_recorder::LoadController::Level kLevels[] = {
+        {"medium", 1},
+        {"fast", 1},
+        {"veryfast", 1},
+        {"ultrafast", 1},
+        {"ultrafast", 2},
+        {"ultrafast", 3},
+    };
+    constexpr size_t kLevelCount = sizeof(kLevels) / sizeof(kLevels[0]);
+
+    constexpr double kSmoothing = 0.1;    // weight of the newest frame
+    constexpr double kOverloaded = 0.9;   // share of the budget that counts as falling behind
+    constexpr double kHeadroom = 0.6;     // predicted share that is safe to step up to
+    constexpr int kMaxLateFrames = 2;
+    constexpr double kStepDownSeconds = 0.5;
+    constexpr double kStepUpSeconds = 3.0;
+    constexpr double kCooldownSeconds = 1.0;
+
+    double elapsedMs(const screen_recorder::FrameTiming &timing)
+    {
+        return timing.grabMs + timing.convertMs + timing.encodeMs;
+    }
+}
+
+namespace screen_recorder
+{
+    LoadController::LoadController(int fps)
+        : mFps(std::max(fps, 1)), mLevel(0), mBusyMs(0), mPrimed(false),
+          mOverloadedFrames(0), mIdleFrames(0), mCooldownFrames(0)
+    {
+    }
+
+    const LoadController::Level &LoadController::level() const
+    {
+        return kLevels[mLevel];
+    }
+
+    double LoadController::budgetMs(size_t level) const
+    {
+        return 1000.0 * kLevels[level].fpsDivisor / mFps;
+    }
+
+    bool LoadController::update(const FrameTiming &timing)
+    {
+        double busy = elapsedMs(timing);
+        mBusyMs = mPrimed ? mBusyMs + kSmoothing * (busy - mBusyMs) : busy;
+        mPrimed = true;
+
+        // Counters are in frames at the current capture rate
+        auto frames = [this](double seconds)
+        {
+            return std::max(3, static_cast<int>(seconds * mFps / kLevels[mLevel].fpsDivisor));
+        };
+
+        double load = mBusyMs / budgetMs(mLevel);
+        bool overloaded = load > kOverloaded || timing.lateFrames > kMaxLateFrames;
+
+        if (mCooldownFrames > 0)
+        {
+            // Let the new level settle before judging it
+            mCooldownFrames--;
+            return false;
+        }
+
+        mOverloadedFrames = overloaded ? mOverloadedFrames + 1 : 0;
+        if (mOverloadedFrames >= frames(kStepDownSeconds) && mLevel + 1 < kLevelCount)
+        {
+            changeLevel(mLevel + 1, timing.lateFrames > kMaxLateFrames ? "frames are late" : "over budget", load);
+            return true;
+        }
+
+        double predicted = mLevel > 0 ? mBusyMs / budgetMs(mLevel - 1) : 1.0;
+        mIdleFrames = predicted < kHeadroom ? mIdleFrames + 1 : 0;
+        if (mIdleFrames >= frames(kStepUpSeconds) && mLevel > 0)
+        {
+            changeLevel(mLevel - 1, "headroom", load);
+            return true;
+        }
+        return false;
+    }
+
+    void LoadController::changeLevel(size_t level, const char *reason, double load)
+    {
+        bool down = level > mLevel;
+        mLevel = level;
+        mOverloadedFrames = 0;
+        mIdleFrames = 0;
+        mCooldownFrames = std::max(3, static_cast<int>(kCooldownSeconds * mFps / kLevels[mLevel].fpsDivisor));
+
+        std::cout << "Load controller: " << reason << " (" << static_cast<int>(load * 100)
+                  << "% of frame budget, " << static_cast<int>(mBusyMs * 10) / 10.0 << " ms/frame), stepping "
+                  << (down ? "down" : "up") << " to preset " << kLevels[mLevel].preset
+                  << " at " << mFps / static_cast<double>(kLevels[mLevel].fpsDivisor) << " fps" << std::endl;
+    }
+}
@@ -0,0 +1,192 @@
+#include "packetFanout.h"
+#include "frameTracer.h"
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+    // Lossless sinks buffer this many times the live queue, minutes of
+    // packets, before the encoder has to wait for them
+    constexpr size_t kLosslessQueueFactor = 16;
+    // After abort() a sink gets this long to return before it is left behind
+    constexpr auto kAbortGrace = std::chrono::seconds(1);
+}
+
+namespace screen_recorder
+{
+    PacketFanout::PacketFanout(size_t queueCapacity)
+        : mQueueCapacity(queueCapacity)
+    {
+    }
+
+    PacketFanout::~PacketFanout()
+    {
+        stop();
+    }
+
+    void PacketFanout::addSink(std::shared_ptr<PacketSink> sink, bool lossless)
+    {
+        auto channel = std::make_shared<Channel>();
+        channel->sink = std::move(sink);
+        channel->lossless = lossless;
+        mChannels.push_back(std::move(channel));
+    }
+
+    void PacketFanout::start(const AVCodecContext *codecContext)
+    {
+        for (auto &channel : mChannels)
+        {
+            channel->parameters = avcodec_parameters_alloc();
+            avcodec_parameters_from_context(channel->parameters, codecContext);
+            channel->timeBase = codecContext->time_base;
+            channel->thread = std::thread([channel]()
+                                          { run(*channel); });
+        }
+    }
+
+    void PacketFanout::push(const AVPacket *packet)
+    {
+        if (mChannels.empty())
+            return;
+
+        // One reference for all sinks; the last one to let go frees it
+        std::shared_ptr<const AVPacket> shared(av_packet_clone(packet), [](AVPacket *p)
+                                               { av_packet_free(&p); });
+        if (!shared)
+            return;
+        bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+
+        for (auto &channel : mChannels)
+        {
+            std::unique_lock<std::mutex> lock(channel->mutex);
+            if (channel->failed || channel->done)
+                continue;
+            if (channel->lossless)
+            {
+                if (channel->queue.size() >= mQueueCapacity * kLosslessQueueFactor)
+                {
+                    if (!channel->stalled)
+                        std::cerr << "Sink " << channel->sink->name() << " is falling behind, waiting for it" << std::endl;
+                    channel->stalled = true;
+                    channel->space.wait(lock, [this, &channel]
+                                        { return channel->queue.size() < mQueueCapacity * kLosslessQueueFactor ||
+                                                 channel->failed || channel->done; });
+                    if (channel->failed || channel->done)
+                        continue;
+                }
+            }
+            else
+            {
+                if (channel->waitForKeyframe && !keyframe)
+                {
+                    channel->dropped++;
+                    continue;
+                }
+                if (channel->queue.size() >= mQueueCapacity)
+                {
+                    if (!channel->waitForKeyframe)
+                        std::cerr << "Sink " << channel->sink->name() << " is falling behind, dropping until the next keyframe" << std::endl;
+                    channel->waitForKeyframe = true;
+                    channel->dropped++;
+                    continue;
+                }
+                channel->waitForKeyframe = false;
+            }
+            channel->queue.push_back(shared);
+            channel->wake.notify_one();
+        }
+    }
+
+    void PacketFanout::run(Channel &channel)
+    {
+        FrameTracer::setThreadName("sink " + channel.sink->name());
+        bool opened = channel.sink->open(channel.parameters, channel.timeBase);
+
+        std::unique_lock<std::mutex> lock(channel.mutex);
+        if (!opened)
+        {
+            std::cerr << "Sink " << channel.sink->name() << " failed to open, skipping it" << std::endl;
+            channel.failed = true;
+        }
+        while (!channel.failed)
+        {
+            channel.wake.wait(lock, [&channel]
+                              { return !channel.queue.empty() || channel.closing; });
+            if (channel.queue.empty())
+                break;
+            std::shared_ptr<const AVPacket> packet = std::move(channel.queue.front());
+            channel.queue.pop_front();
+            channel.space.notify_one();
+
+            lock.unlock();
+            bool ok;
+            {
+                // The capture loop stamps packets with their frame tick
+                TraceSpan span("write", packet->pts);
+                ok = channel.sink->write(packet);
+            }
+            packet.reset();
+            lock.lock();
+
+            if (!ok)
+            {
+                std::cerr << "Sink " << channel.sink->name() << " failed to write, skipping it" << std::endl;
+                channel.failed = true;
+                break;
+            }
+            channel.written++;
+        }
+        channel.queue.clear();
+        channel.space.notify_all();
+        lock.unlock();
+
+        channel.sink->close();
+
+        lock.lock();
+        channel.done = true;
+        channel.space.notify_all();
+        channel.finished.notify_all();
+    }
+
+    void PacketFanout::stop(int timeoutMs)
+    {
+        for (auto &channel : mChannels)
+        {
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            channel->closing = true;
+            channel->wake.notify_one();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (auto &channel : mChannels)
+        {
+            if (!channel->thread.joinable())
+                continue;
+            bool done;
+            {
+                std::unique_lock<std::mutex> lock(channel->mutex);
+                auto finished = [&channel]
+                { return channel->done; };
+                done = channel->finished.wait_until(lock, deadline, finished);
+                if (!done)
+                {
+                    std::cerr << "Sink " << channel->sink->name() << " did not finish in time, aborting it" << std::endl;
+                    channel->sink->abort();
+                    done = channel->finished.wait_for(lock, kAbortGrace, finished);
+                }
+            }
+            if (!done)
+            {
+                // Blocked where the interrupt callback is never polled (e.g. a
+                // write to a hung file system); the thread owns its channel
+                std::cerr << "Sink " << channel->sink->name() << " is still blocked, leaving it behind" << std::endl;
+                channel->thread.detach();
+                continue;
+            }
+            channel->thread.join();
+            std::cout << "Sink " << channel->sink->name() << ": " << channel->written << " packets written, "
+                      << channel->dropped << " dropped" << (channel->failed ? " (failed)" : "") << std::endl;
+        }
+        mChannels.clear();
+    }
+}
@@ -0,0 +1,165 @@
+#include "packetSink.h"
+#include "frameTracer.h"
+#include <iostream>
+
+namespace screen_recorder
+{
+    MuxerSink::MuxerSink(const std::string &url, const std::string &formatName, bool writeKeyframeIndex)
+        : mUrl(url), mFormatName(formatName), mWriteKeyframeIndex(writeKeyframeIndex),
+          mFormatContext(nullptr), mPacket(nullptr), mTimeBase{1, 1}, mHeaderWritten(false)
+    {
+    }
+
+    MuxerSink::~MuxerSink()
+    {
+        close();
+    }
+
+    int MuxerSink::interrupted(void *opaque)
+    {
+        return static_cast<MuxerSink *>(opaque)->mAborted ? 1 : 0;
+    }
+
+    bool MuxerSink::open(const AVCodecParameters *parameters, AVRational timeBase)
+    {
+        close();
+        mAborted = false;
+        mTimeBase = timeBase;
+        avformat_network_init();
+
+        avformat_alloc_output_context2(&mFormatContext, nullptr,
+                                       mFormatName.empty() ? nullptr : mFormatName.c_str(), mUrl.c_str());
+        if (!mFormatContext && mFormatName.empty())
+            avformat_alloc_output_context2(&mFormatContext, nullptr, "mpegts", mUrl.c_str());
+        if (!mFormatContext)
+        {
+            std::cerr << "Failed to create format context for " << mUrl << std::endl;
+            return false;
+        }
+        mFormatContext->interrupt_callback = {&MuxerSink::interrupted, this};
+
+        AVStream *stream = avformat_new_stream(mFormatContext, nullptr);
+        if (!stream || avcodec_parameters_copy(stream->codecpar, parameters) < 0)
+        {
+            std::cerr << "Failed to create video stream for " << mUrl << std::endl;
+            close();
+            return false;
+        }
+        stream->codecpar->codec_tag = 0;
+        stream->time_base = timeBase;
+
+        if (!(mFormatContext->oformat->flags & AVFMT_NOFILE) &&
+            avio_open2(&mFormatContext->pb, mUrl.c_str(), AVIO_FLAG_WRITE, &mFormatContext->interrupt_callback, nullptr) < 0)
+        {
+            std::cerr << "Failed to open output " << mUrl << std::endl;
+            close();
+            return false;
+        }
+        if (avformat_write_header(mFormatContext, nullptr) < 0)
+        {
+            std::cerr << "Failed to write header for " << mUrl << std::endl;
+            close();
+            return false;
+        }
+        mHeaderWritten = true;
+
+        // The muxer settles the stream time base in write_header
+        if (mWriteKeyframeIndex)
+            mKeyframeIndex.open(keyframeIndexPath(mUrl), stream->time_base.num, stream->time_base.den);
+        mPacket = av_packet_alloc();
+        return true;
+    }
+
+    bool MuxerSink::write(const std::shared_ptr<const AVPacket> &packet)
+    {
+        if (!mHeaderWritten)
+            return false;
+
+        // A new reference, not a copy: the payload stays shared with the
+        // other sinks, only the timestamps become ours to rescale
+        if (av_packet_ref(mPacket, packet.get()) < 0)
+            return false;
+        AVStream *stream = mFormatContext->streams[0];
+        av_packet_rescale_ts(mPacket, mTimeBase, stream->time_base);
+        mPacket->stream_index = stream->index;
+
+        // With a single stream nothing is held back for interleaving, so
+        // the current position is where this packet lands
+        if ((mPacket->flags & AV_PKT_FLAG_KEY) && mKeyframeIndex.isOpen() && mFormatContext->pb)
+            mKeyframeIndex.append(mPacket->pts, mPacket->dts, avio_tell(mFormatContext->pb));
+        TraceSpan span("mux", packet->pts);
+        return av_interleaved_write_frame(mFormatContext, mPacket) >= 0;
+    }
+
+    void MuxerSink::close()
+    {
+        if (mFormatContext)
+        {
+            if (mHeaderWritten)
+                av_write_trailer(mFormatContext);
+            if (!(mFormatContext->oformat->flags & AVFMT_NOFILE) && mFormatContext->pb)
+                avio_closep(&mFormatContext->pb);
+            avformat_free_context(mFormatContext);
+            mFormatContext = nullptr;
+        }
+        if (mPacket)
+            av_packet_free(&mPacket);
+        mKeyframeIndex.close();
+        mHeaderWritten = false;
+    }
+
+    void MuxerSink::abort()
+    {
+        mAborted = true;
+    }
+
+    MemorySink::MemorySink(size_t maxBytes)
+        : mMaxBytes(maxBytes), mBytes(0), mTimeBase{1, 1}
+    {
+    }
+
+    bool MemorySink::open(const AVCodecParameters *, AVRational timeBase)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPackets.clear();
+        mBytes = 0;
+        mTimeBase = timeBase;
+        return true;
+    }
+
+    bool MemorySink::write(const std::shared_ptr<const AVPacket> &packet)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // Nothing before the first keyframe can be decoded
+        if (mPackets.empty() && !(packet->flags & AV_PKT_FLAG_KEY))
+            return true;
+        mPackets.push_back(packet);
+        mBytes += packet->size;
+
+        // Drop whole GOPs from the front, but never the one being written
+        while (mBytes > mMaxBytes)
+        {
+            auto next = mPackets.begin() + 1;
+            while (next != mPackets.end() && !((*next)->flags & AV_PKT_FLAG_KEY))
+                next++;
+            if (next == mPackets.end())
+                break;
+            for (auto it = mPackets.begin(); it != next; it++)
+                mBytes -= (*it)->size;
+            mPackets.erase(mPackets.begin(), next);
+        }
+        return true;
+    }
+
+    AVRational MemorySink::timeBase() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTimeBase;
+    }
+
+    std::vector<std::shared_ptr<const AVPacket>> MemorySink::snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return {mPackets.begin(), mPackets.end()};
+    }
+}
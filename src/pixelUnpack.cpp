@@ -0,0 +1,237 @@
+#include "pixelUnpack.h"
+#include <X11/Xutil.h>
+#include <cstring>
+#include <libyuv.h>
+
+namespace
+{
+    constexpr bool kHostLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+    // Channel layout of a pixel held in a Pixel-sized integer (host order)
+    template <typename P, int RShift, int RBits, int GShift, int GBits, int BShift, int BBits>
+    struct PackedFormat
+    {
+        using Pixel = P;
+        static constexpr int rShift = RShift, rBits = RBits;
+        static constexpr int gShift = GShift, gBits = GBits;
+        static constexpr int bShift = BShift, bBits = BBits;
+    };
+
+    using Rgb565 = PackedFormat<uint16_t, 11, 5, 5, 6, 0, 5>;
+    using Bgr565 = PackedFormat<uint16_t, 0, 5, 5, 6, 11, 5>;
+    using Xrgb8888 = PackedFormat<uint32_t, 16, 8, 8, 8, 0, 8>;
+    using Xbgr8888 = PackedFormat<uint32_t, 0, 8, 8, 8, 16, 8>;
+    using Xrgb2101010 = PackedFormat<uint32_t, 20, 10, 10, 10, 0, 10>;
+    using Xbgr2101010 = PackedFormat<uint32_t, 0, 10, 10, 10, 20, 10>;
+
+    inline uint16_t byteSwap(uint16_t v) { return __builtin_bswap16(v); }
+    inline uint32_t byteSwap(uint32_t v) { return __builtin_bswap32(v); }
+
+    // Widen an n-bit channel to 8 bits, replicating the top bits into the
+    // bottom so full scale stays full scale
+    template <int Bits>
+    inline uint8_t expand(uint32_t v)
+    {
+        if constexpr (Bits >= 8)
+            return static_cast<uint8_t>(v >> (Bits - 8));
+        else
+            return static_cast<uint8_t>((v << (8 - Bits)) | (v >> (2 * Bits - 8)));
+    }
+
+    // Straight-line per-pixel body with every shift and mask a compile-time
+    // constant, so the compiler can vectorize the row loop. LittleEndian is
+    // the image byte order (LSBFirst), which may differ from the host's.
+    template <typename Format, bool LittleEndian>
+    void unpackPacked(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        using Pixel = typename Format::Pixel;
+        constexpr uint32_t rMask = (1u << Format::rBits) - 1;
+        constexpr uint32_t gMask = (1u << Format::gBits) - 1;
+        constexpr uint32_t bMask = (1u << Format::bBits) - 1;
+
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *in = src + static_cast<size_t>(y) * srcStride;
+            uint8_t *__restrict out = dst + static_cast<size_t>(y) * dstStride;
+            for (int x = 0; x < width; x++)
+            {
+                Pixel p;
+                std::memcpy(&p, in + x * sizeof(Pixel), sizeof(Pixel));
+                if constexpr (LittleEndian != kHostLittleEndian)
+                    p = byteSwap(p);
+                uint32_t v = p;
+                out[x * 4 + 0] = expand<Format::bBits>((v >> Format::bShift) & bMask);
+                out[x * 4 + 1] = expand<Format::gBits>((v >> Format::gShift) & gMask);
+                out[x * 4 + 2] = expand<Format::rBits>((v >> Format::rShift) & rMask);
+                out[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    // 24bpp packed, three bytes per pixel; RedFirst means R,G,B in memory
+    template <bool RedFirst>
+    void unpackPacked24(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *in = src + static_cast<size_t>(y) * srcStride;
+            uint8_t *__restrict out = dst + static_cast<size_t>(y) * dstStride;
+            for (int x = 0; x < width; x++)
+            {
+                out[x * 4 + 0] = in[x * 3 + (RedFirst ? 2 : 0)];
+                out[x * 4 + 1] = in[x * 3 + 1];
+                out[x * 4 + 2] = in[x * 3 + (RedFirst ? 0 : 2)];
+                out[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    // Where libyuv has hand-written SIMD for the exact layout, use it. Its
+    // formats are defined as little-endian memory layouts.
+    template <>
+    void unpackPacked<Rgb565, true>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::RGB565ToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    template <>
+    void unpackPacked<Xbgr8888, true>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::ABGRToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    template <>
+    void unpackPacked<Xrgb2101010, true>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::AR30ToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    template <>
+    void unpackPacked<Xbgr2101010, true>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::AB30ToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    template <>
+    void unpackPacked24<false>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::RGB24ToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    template <>
+    void unpackPacked24<true>(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height)
+    {
+        libyuv::RAWToARGB(src, srcStride, dst, dstStride, width, height);
+    }
+
+    struct FormatEntry
+    {
+        int bitsPerPixel;
+        unsigned long redMask;
+        unsigned long greenMask;
+        unsigned long blueMask;
+        pixel_unpack::UnpackFunction lsbFirst;
+        pixel_unpack::UnpackFunction msbFirst;
+        const char *name;
+        bool bgrxWhenLSBFirst; // memory layout matches BGRX for LSBFirst images
+    };
+
+    // LSBFirst images of the common layouts get the libyuv kernels above,
+    // everything else the generic template.
+    template <typename Format>
+    constexpr FormatEntry entry(const char *name, bool bgrxWhenLSBFirst = false)
+    {
+        return {static_cast<int>(sizeof(typename Format::Pixel) * 8),
+                ((1ul << Format::rBits) - 1) << Format::rShift,
+                ((1ul << Format::gBits) - 1) << Format::gShift,
+                ((1ul << Format::bBits) - 1) << Format::bShift,
+                &unpackPacked<Format, true>,
+                &unpackPacked<Format, false>,
+                name,
+                bgrxWhenLSBFirst};
+    }
+
+    const FormatEntry kFormats[] = {
+        entry<Rgb565>("rgb565"),
+        entry<Bgr565>("bgr565"),
+        entry<Xrgb8888>("xrgb8888", true),
+        entry<Xbgr8888>("xbgr8888"),
+        entry<Xrgb2101010>("xrgb2101010"),
+        entry<Xbgr2101010>("xbgr2101010"),
+    };
+
+    int lowestBit(unsigned long mask)
+    {
+        return mask ? __builtin_ctzl(mask) : 0;
+    }
+
+    int bitCount(unsigned long mask)
+    {
+        return __builtin_popcountl(mask);
+    }
+}
+
+namespace pixel_unpack
+{
+    Unpacker selectUnpacker(const XImage *image)
+    {
+        Unpacker result;
+        if (image->format != ZPixmap)
+            return result;
+
+        if (image->bits_per_pixel == 24 &&
+            image->green_mask == 0x00FF00 &&
+            (image->red_mask == 0xFF0000 || image->red_mask == 0x0000FF))
+        {
+            // Byte order decides which of the outer bytes comes first in memory
+            bool redHigh = image->red_mask == 0xFF0000;
+            bool redFirst = redHigh == (image->byte_order == MSBFirst);
+            result.unpack = redFirst ? &unpackPacked24<true> : &unpackPacked24<false>;
+            result.name = redFirst ? "rgb888" : "bgr888";
+            return result;
+        }
+
+        for (const FormatEntry &format : kFormats)
+        {
+            if (format.bitsPerPixel == image->bits_per_pixel &&
+                format.redMask == image->red_mask &&
+                format.greenMask == image->green_mask &&
+                format.blueMask == image->blue_mask)
+            {
+                result.native = format.bgrxWhenLSBFirst && image->byte_order == LSBFirst;
+                result.unpack = image->byte_order == LSBFirst ? format.lsbFirst : format.msbFirst;
+                result.name = format.name;
+                return result;
+            }
+        }
+        return result;
+    }
+
+    void genericUnpack(XImage *image, uint8_t *dst, int dstStride, int width, int height)
+    {
+        int rShift = lowestBit(image->red_mask), rBits = bitCount(image->red_mask);
+        int gShift = lowestBit(image->green_mask), gBits = bitCount(image->green_mask);
+        int bShift = lowestBit(image->blue_mask), bBits = bitCount(image->blue_mask);
+
+        auto channel = [](unsigned long pixel, unsigned long mask, int shift, int bits) -> uint8_t
+        {
+            if (bits == 0)
+                return static_cast<uint8_t>(pixel); // no masks (indexed visual): show as gray
+            unsigned long v = (pixel & mask) >> shift;
+            return static_cast<uint8_t>(bits >= 8 ? v >> (bits - 8) : (v * 255) / ((1ul << bits) - 1));
+        };
+
+        for (int y = 0; y < height; y++)
+        {
+            uint8_t *out = dst + static_cast<size_t>(y) * dstStride;
+            for (int x = 0; x < width; x++)
+            {
+                unsigned long pixel = XGetPixel(image, x, y);
+                out[x * 4 + 0] = channel(pixel, image->blue_mask, bShift, bBits);
+                out[x * 4 + 1] = channel(pixel, image->green_mask, gShift, gBits);
+                out[x * 4 + 2] = channel(pixel, image->red_mask, rShift, rBits);
+                out[x * 4 + 3] = 255;
+            }
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#include "replaySource.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint64_t kFrameAlignment = 4096;
+    // Larger than any X screen; keeps sizes and strides within int
+    constexpr uint32_t kMaxRawFrameDimension = 32768;
+
+    uint64_t alignUp(uint64_t value)
+    {
+        return (value + kFrameAlignment - 1) & ~(kFrameAlignment - 1);
+    }
+}
+
+namespace screen_recorder
+{
+    RawFrameWriter::RawFrameWriter()
+        : mFile(nullptr), mHeader()
+    {
+    }
+
+    RawFrameWriter::~RawFrameWriter()
+    {
+        close();
+    }
+
+    bool RawFrameWriter::open(const std::string &path, int width, int height, int fps)
+    {
+        close();
+        mFile = fopen(path.c_str(), "wb");
+        if (!mFile)
+        {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+
+        std::memcpy(mHeader.magic, kRawFrameMagic, sizeof(mHeader.magic));
+        mHeader.width = width;
+        mHeader.height = height;
+        mHeader.stride = width * 4;
+        mHeader.fps = fps;
+        mHeader.frameSize = alignUp(static_cast<uint64_t>(mHeader.stride) * height);
+        mHeader.dataOffset = alignUp(sizeof(RawFrameFileHeader));
+
+        if (fwrite(&mHeader, sizeof(mHeader), 1, mFile) != 1 ||
+            fseek(mFile, mHeader.dataOffset, SEEK_SET) != 0)
+        {
+            std::cerr << "Failed to write raw frame header: " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool RawFrameWriter::write(const Frame &frame)
+    {
+        if (!mFile || frame.format != PixelFormat::BGRX ||
+            frame.width != static_cast<int>(mHeader.width) || frame.height != static_cast<int>(mHeader.height))
+            return false;
+
+        for (uint32_t y = 0; y < mHeader.height; y++)
+        {
+            if (fwrite(frame.data[0] + static_cast<size_t>(y) * frame.stride[0], mHeader.stride, 1, mFile) != 1)
+                return false;
+        }
+        // Pad to the next frame boundary so every frame maps page aligned
+        uint64_t padding = mHeader.frameSize - static_cast<uint64_t>(mHeader.stride) * mHeader.height;
+        if (padding && fseek(mFile, padding, SEEK_CUR) != 0)
+            return false;
+        return true;
+    }
+
+    void RawFrameWriter::close()
+    {
+        if (!mFile)
+            return;
+        // Make sure the trailing padding of the last frame exists on disk
+        long end = ftell(mFile);
+        fflush(mFile);
+        if (end > 0 && ftruncate(fileno(mFile), end) != 0)
+            std::cerr << "Failed to finalize raw frame file" << std::endl;
+        fclose(mFile);
+        mFile = nullptr;
+    }
+
+    ReplaySource::ReplaySource(const std::string &path, bool loop, bool realtime)
+        : mHeader(), mFrameCount(0), mLoop(loop), mRealtime(realtime), mAtEnd(false)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "Failed to open replay file " << path << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(RawFrameFileHeader) ||
+            pread(fd, &mHeader, sizeof(mHeader), 0) != sizeof(mHeader) ||
+            std::memcmp(mHeader.magic, kRawFrameMagic, sizeof(mHeader.magic)) != 0)
+        {
+            std::cerr << "Not a raw frame file: " << path << std::endl;
+            ::close(fd);
+            return;
+        }
+
+        // Every frame handed out is read in full by the converter, so the
+        // header has to describe rows that fit and frames that lie in the file
+        size_t size = info.st_size;
+        uint64_t frameBytes = static_cast<uint64_t>(mHeader.stride) * mHeader.height;
+        if (mHeader.width == 0 || mHeader.height == 0 || mHeader.width > kMaxRawFrameDimension ||
+            mHeader.height > kMaxRawFrameDimension || mHeader.stride < static_cast<uint64_t>(mHeader.width) * 4 ||
+            mHeader.stride > kMaxRawFrameDimension * 4 || mHeader.frameSize < frameBytes ||
+            mHeader.dataOffset < sizeof(RawFrameFileHeader) || mHeader.dataOffset > size ||
+            (size - mHeader.dataOffset) / mHeader.frameSize == 0)
+        {
+            std::cerr << "Malformed or truncated raw frame file: " << path << std::endl;
+            ::close(fd);
+            return;
+        }
+
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            std::cerr << "Failed to map replay file " << path << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+
+        mMapping = std::shared_ptr<const uint8_t>(static_cast<const uint8_t *>(mapping),
+                                                  [size](const uint8_t *p)
+                                                  { munmap(const_cast<uint8_t *>(p), size); });
+        // A partly written last frame is left out
+        mFrameCount = (size - mHeader.dataOffset) / mHeader.frameSize;
+        std::cout << "Replaying " << mFrameCount << " frames of " << mHeader.width << "x" << mHeader.height
+                  << " from " << path << std::endl;
+    }
+
+    ReplaySource::~ReplaySource() = default;
+
+    std::shared_ptr<const Frame> ReplaySource::grab(uint64_t index)
+    {
+        if (!mMapping || mFrameCount == 0 || (!mLoop && index >= mFrameCount))
+        {
+            mAtEnd = true;
+            return nullptr;
+        }
+
+        uint64_t position = index % mFrameCount;
+        auto frame = std::make_shared<Frame>();
+        frame->width = mHeader.width;
+        frame->height = mHeader.height;
+        frame->format = PixelFormat::BGRX;
+        frame->data[0] = mMapping.get() + mHeader.dataOffset + position * mHeader.frameSize;
+        frame->stride[0] = mHeader.stride;
+        frame->timestampUs = static_cast<int64_t>(index * 1000000 / (mHeader.fps ? mHeader.fps : 30));
+        frame->index = index;
+        // The mapping outlives the source for as long as a frame points into it
+        frame->owner = mMapping;
+        return frame;
+    }
+}
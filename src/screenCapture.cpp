@@ -0,0 +1,546 @@
+#include "screenCapture.h"
+#include "desktopCapturer.h"
+#include "clipExtractor.h"
+#include "syntheticSource.h"
+#include "replaySource.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+struct sc_session
+{
+    std::unique_ptr<screen_recorder::DesktopCapture> capture;
+};
+
+struct sc_frame
+{
+    std::shared_ptr<const screen_recorder::Frame> frame;
+};
+
+struct sc_frame_ring
+{
+    screen_recorder::FrameRingReader reader;
+};
+
+struct sc_memory_output
+{
+    std::shared_ptr<screen_recorder::MemorySink> sink;
+};
+
+struct sc_packet
+{
+    AVPacket *packet;
+    int timeBaseNum;
+    int timeBaseDen;
+};
+
+namespace
+{
+    screen_recorder::PixelFormat toPixelFormat(sc_pixel_format format)
+    {
+        return format == SC_PIXEL_FORMAT_I420 ? screen_recorder::PixelFormat::I420 : screen_recorder::PixelFormat::BGRX;
+    }
+
+    // Exceptions must not cross into C callers
+    template <typename Body>
+    int guarded(Body &&body)
+    {
+        try
+        {
+            return body();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return SC_ERROR;
+        }
+        catch (...)
+        {
+            return SC_ERROR;
+        }
+    }
+
+    void fillFrameInfo(const screen_recorder::Frame &f, sc_frame_info *info)
+    {
+        info->width = f.width;
+        info->height = f.height;
+        info->format = f.format == screen_recorder::PixelFormat::I420 ? SC_PIXEL_FORMAT_I420 : SC_PIXEL_FORMAT_BGRX;
+        for (int i = 0; i < 3; i++)
+        {
+            info->data[i] = f.data[i];
+            info->stride[i] = f.stride[i];
+        }
+        info->timestamp_us = f.timestampUs;
+        info->index = f.index;
+    }
+}
+
+extern "C"
+{
+    sc_session *sc_session_open(void)
+    {
+        try
+        {
+            auto session = std::make_unique<sc_session>();
+            session->capture = std::make_unique<screen_recorder::DesktopCapture>();
+            return session.release();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    sc_session *sc_session_open_headless(void)
+    {
+        try
+        {
+            auto session = std::make_unique<sc_session>();
+            session->capture = std::make_unique<screen_recorder::DesktopCapture>(false);
+            return session.release();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    void sc_session_close(sc_session *session)
+    {
+        delete session;
+    }
+
+    int sc_session_list_windows(sc_session *session, sc_window_info *windows, int capacity)
+    {
+        if (!session || (capacity > 0 && !windows))
+            return SC_ERROR_INVALID_ARGUMENT;
+
+        // Query on a private connection so enumeration never queues behind the capture thread
+        Display *display = XOpenDisplay(nullptr);
+        if (!display)
+            return SC_ERROR;
+
+        const std::vector<Window> *listed = nullptr;
+        int status = guarded([&]
+                             {
+                                 listed = &session->capture->getCapturableWindows();
+                                 return SC_OK;
+                             });
+        if (status != SC_OK)
+        {
+            XCloseDisplay(display);
+            return status;
+        }
+        const auto &capturable = *listed;
+        int count = 0;
+        for (Window window : capturable)
+        {
+            if (count < capacity)
+            {
+                sc_window_info &info = windows[count];
+                std::memset(&info, 0, sizeof(info));
+                info.id = window;
+
+                XWindowAttributes attrs;
+                if (XGetWindowAttributes(display, window, &attrs))
+                {
+                    info.x = attrs.x;
+                    info.y = attrs.y;
+                    info.width = attrs.width;
+                    info.height = attrs.height;
+                }
+
+                char *name = nullptr;
+                if (XFetchName(display, window, &name) && name)
+                {
+                    std::strncpy(info.name, name, sizeof(info.name) - 1);
+                    XFree(name);
+                }
+            }
+            count++;
+        }
+        XCloseDisplay(display);
+        return count;
+    }
+
+    int sc_session_set_frame_callback(sc_session *session, sc_frame_callback callback, void *user_data)
+    {
+        return sc_session_set_frame_callback_format(session, SC_PIXEL_FORMAT_BGRX, callback, user_data);
+    }
+
+    int sc_session_set_frame_callback_format(sc_session *session, sc_pixel_format format, sc_frame_callback callback, void *user_data)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (!callback)
+        {
+            session->capture->setFrameCallback(nullptr);
+            return SC_OK;
+        }
+        return guarded([&]
+                       {
+                           session->capture->setFrameCallback(
+                               [callback, user_data](const std::shared_ptr<const screen_recorder::Frame> &frame)
+                               {
+                                   sc_frame borrowed{frame};
+                                   callback(&borrowed, user_data);
+                               },
+                               toPixelFormat(format));
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_set_packet_callback(sc_session *session, sc_packet_callback callback, void *user_data)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (!callback)
+        {
+            session->capture->setPacketCallback(nullptr);
+            return SC_OK;
+        }
+        return guarded([&]
+                       {
+                           session->capture->setPacketCallback(
+                               [callback, user_data](const AVPacket *packet, int timeBaseNum, int timeBaseDen)
+                               {
+                                   sc_packet borrowed{const_cast<AVPacket *>(packet), timeBaseNum, timeBaseDen};
+                                   callback(&borrowed, user_data);
+                               });
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_add_output(sc_session *session, const char *url)
+    {
+        if (!session || !url || !*url)
+            return SC_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       {
+                           session->capture->addPacketSink(std::make_shared<screen_recorder::MuxerSink>(url));
+                           return SC_OK;
+                       });
+    }
+
+    sc_memory_output *sc_session_add_memory_output(sc_session *session, size_t max_bytes)
+    {
+        if (!session || max_bytes == 0)
+            return nullptr;
+        try
+        {
+            auto output = std::make_unique<sc_memory_output>();
+            output->sink = std::make_shared<screen_recorder::MemorySink>(max_bytes);
+            session->capture->addPacketSink(output->sink);
+            return output.release();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    int sc_memory_output_snapshot(const sc_memory_output *output, sc_packet **packets, int capacity)
+    {
+        if (!output || (capacity > 0 && !packets))
+            return SC_ERROR_INVALID_ARGUMENT;
+        return guarded([&]() -> int
+                       {
+                           auto buffered = output->sink->snapshot();
+                           AVRational timeBase = output->sink->timeBase();
+                           int count = 0;
+                           for (const auto &packet : buffered)
+                           {
+                               if (count == capacity)
+                                   break;
+                               // A new reference; the payload is shared with the buffer
+                               AVPacket *clone = av_packet_clone(packet.get());
+                               sc_packet *reference = clone ? new (std::nothrow) sc_packet{clone, timeBase.num, timeBase.den} : nullptr;
+                               if (!reference)
+                               {
+                                   av_packet_free(&clone);
+                                   for (int i = 0; i < count; i++)
+                                       sc_packet_unref(packets[i]);
+                                   return SC_ERROR;
+                               }
+                               packets[count++] = reference;
+                           }
+                           return static_cast<int>(buffered.size());
+                       });
+    }
+
+    void sc_memory_output_release(sc_memory_output *output)
+    {
+        delete output;
+    }
+
+    int sc_session_clear_outputs(sc_session *session)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->clearPacketSinks();
+        return SC_OK;
+    }
+
+    int sc_session_export_frames(sc_session *session, const char *name, sc_pixel_format format, int slot_count)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (!name || !*name)
+        {
+            session->capture->setFrameRing(nullptr);
+            return SC_OK;
+        }
+        return guarded([&]
+                       {
+                           auto ring = std::make_shared<screen_recorder::FrameRingWriter>(name, toPixelFormat(format), slot_count);
+                           if (!ring->isOpen())
+                               return SC_ERROR;
+                           session->capture->setFrameRing(std::move(ring));
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_set_adaptive(sc_session *session, int enabled)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setAdaptiveQuality(enabled != 0);
+        return SC_OK;
+    }
+
+    int sc_session_set_conversion_slices(sc_session *session, int slices)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setConversionSlices(slices);
+        return SC_OK;
+    }
+
+    int sc_session_set_composite(sc_session *session, int enabled)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setCompositeCapture(enabled != 0);
+        return SC_OK;
+    }
+
+    int sc_session_set_timelapse(sc_session *session, int idle_fps)
+    {
+        if (!session || idle_fps < 0)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setTimeLapse(idle_fps);
+        return SC_OK;
+    }
+
+    int sc_session_set_crop(sc_session *session, int x, int y, int width, int height)
+    {
+        if (!session || x < 0 || y < 0 || width < 0 || height < 0)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setCrop({x, y, width, height});
+        return SC_OK;
+    }
+
+    int sc_session_set_output_size(sc_session *session, int width, int height)
+    {
+        if (!session || width < 0 || height < 0)
+            return SC_ERROR_INVALID_ARGUMENT;
+        session->capture->setOutputSize(width, height);
+        return SC_OK;
+    }
+
+    int sc_session_set_trace(sc_session *session, const char *path)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       {
+                           session->capture->setTracePath(path ? path : "");
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_start(sc_session *session, unsigned long window, const char *filename, int fps, int duration_seconds)
+    {
+        if (!session || fps <= 0)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (session->capture->isCapturing())
+            return SC_ERROR_BUSY;
+        return guarded([&]
+                       {
+                           // Otherwise a false return means the window could not be opened
+                           if (!session->capture->startCaptureAsync(window, filename ? filename : "", fps, duration_seconds))
+                               return session->capture->isCapturing() ? SC_ERROR_BUSY : SC_ERROR_INVALID_ARGUMENT;
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_start_synthetic(sc_session *session, const char *pattern, int width, int height, int fps, const char *filename, int duration_seconds)
+    {
+        screen_recorder::SyntheticPattern parsed;
+        if (!session || !pattern || !screen_recorder::parseSyntheticPattern(pattern, parsed) || width <= 0 || height <= 0 || fps <= 0)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (session->capture->isCapturing())
+            return SC_ERROR_BUSY;
+        return guarded([&]
+                       {
+                           auto source = std::make_unique<screen_recorder::SyntheticSource>(parsed, width, height, fps);
+                           if (!session->capture->startCaptureAsync(std::move(source), filename ? filename : "", fps, duration_seconds))
+                               return session->capture->isCapturing() ? SC_ERROR_BUSY : SC_ERROR;
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_start_replay(sc_session *session, const char *path, const char *filename, int fps, int duration_seconds)
+    {
+        if (!session || !path)
+            return SC_ERROR_INVALID_ARGUMENT;
+        if (session->capture->isCapturing())
+            return SC_ERROR_BUSY;
+        return guarded([&]
+                       {
+                           auto source = std::make_unique<screen_recorder::ReplaySource>(path);
+                           if (!source->isOpen())
+                               return SC_ERROR;
+                           if (!session->capture->startCaptureAsync(std::move(source), filename ? filename : "", fps, duration_seconds))
+                               return session->capture->isCapturing() ? SC_ERROR_BUSY : SC_ERROR;
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_stop(sc_session *session)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       {
+                           session->capture->stopCapture();
+                           return SC_OK;
+                       });
+    }
+
+    int sc_session_is_capturing(const sc_session *session)
+    {
+        return session && session->capture->isCapturing() ? 1 : 0;
+    }
+
+    int sc_session_get_startup_timing(const sc_session *session, double *first_frame_ms, double *first_packet_ms)
+    {
+        if (!session)
+            return SC_ERROR_INVALID_ARGUMENT;
+        screen_recorder::StartupTiming timing = session->capture->getStartupTiming();
+        if (first_frame_ms)
+            *first_frame_ms = timing.firstFrameMs;
+        if (first_packet_ms)
+            *first_packet_ms = timing.firstPacketMs;
+        return SC_OK;
+    }
+
+    void sc_frame_get_info(const sc_frame *frame, sc_frame_info *info)
+    {
+        if (!frame || !info)
+            return;
+        fillFrameInfo(*frame->frame, info);
+    }
+
+    sc_frame *sc_frame_ref(const sc_frame *frame)
+    {
+        if (!frame)
+            return nullptr;
+        return new (std::nothrow) sc_frame{frame->frame};
+    }
+
+    void sc_frame_unref(sc_frame *frame)
+    {
+        delete frame;
+    }
+
+    void sc_packet_get_info(const sc_packet *packet, sc_packet_info *info)
+    {
+        if (!packet || !info)
+            return;
+        info->data = packet->packet->data;
+        info->size = packet->packet->size;
+        info->pts = packet->packet->pts;
+        info->dts = packet->packet->dts;
+        info->keyframe = (packet->packet->flags & AV_PKT_FLAG_KEY) ? 1 : 0;
+        info->time_base_num = packet->timeBaseNum;
+        info->time_base_den = packet->timeBaseDen;
+    }
+
+    sc_packet *sc_packet_ref(const sc_packet *packet)
+    {
+        if (!packet)
+            return nullptr;
+        // av_packet_clone only bumps the buffer refcount, the bitstream is shared
+        AVPacket *clone = av_packet_clone(packet->packet);
+        if (!clone)
+            return nullptr;
+        sc_packet *reference = new (std::nothrow) sc_packet{clone, packet->timeBaseNum, packet->timeBaseDen};
+        if (!reference)
+            av_packet_free(&clone);
+        return reference;
+    }
+
+    void sc_packet_unref(sc_packet *packet)
+    {
+        if (!packet)
+            return;
+        av_packet_free(&packet->packet);
+        delete packet;
+    }
+
+    int sc_clip_extract(const char *input, double start_seconds, double end_seconds, const char *output)
+    {
+        if (!input || !output)
+            return SC_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       { return screen_recorder::extractClip(input, start_seconds, end_seconds, output) ? SC_OK : SC_ERROR; });
+    }
+
+    sc_frame_ring *sc_frame_ring_open(const char *name)
+    {
+        if (!name)
+            return nullptr;
+        auto ring = std::unique_ptr<sc_frame_ring>(new (std::nothrow) sc_frame_ring);
+        if (!ring || !ring->reader.open(name))
+            return nullptr;
+        return ring.release();
+    }
+
+    void sc_frame_ring_close(sc_frame_ring *ring)
+    {
+        delete ring;
+    }
+
+    int sc_frame_ring_acquire_latest(sc_frame_ring *ring, uint64_t after_sequence, sc_frame_info *info, uint64_t *sequence)
+    {
+        if (!ring || !info)
+            return SC_ERROR_INVALID_ARGUMENT;
+        screen_recorder::FrameRingView view;
+        if (!ring->reader.acquireLatest(view, after_sequence))
+            return SC_ERROR;
+        fillFrameInfo(view.frame, info);
+        if (sequence)
+            *sequence = view.sequence;
+        return SC_OK;
+    }
+
+    int sc_frame_ring_is_valid(const sc_frame_ring *ring, uint64_t sequence)
+    {
+        if (!ring)
+            return 0;
+        screen_recorder::FrameRingView view;
+        view.sequence = sequence;
+        return ring->reader.isValid(view) ? 1 : 0;
+    }
+}
@@ -0,0 +1,160 @@
+#include "sliceConverter.h"
+#include "frameTracer.h"
+#include <algorithm>
+#include <string>
+#include <libyuv.h>
+
+namespace
+{
+    // Below this many rows per slice the wake-up costs more than it saves
+    constexpr int kMinSliceRows = 270;
+    // Source plus destination rows of one block should fit in a typical L2
+    constexpr int kBlockBytes = 256 * 1024;
+
+    int evenRows(int rows)
+    {
+        return (rows + 1) & ~1;
+    }
+}
+
+namespace screen_recorder
+{
+    SliceConverter::SliceConverter(int sliceCount, int height)
+        : mJob(), mGeneration(0), mPending(0), mShutdown(false)
+    {
+        if (sliceCount <= 0)
+        {
+            int cores = std::max(1u, std::thread::hardware_concurrency());
+            sliceCount = std::clamp(height / kMinSliceRows, 1, cores);
+        }
+        // Every slice needs at least one row pair
+        sliceCount = std::clamp(sliceCount, 1, std::max(1, height / 2));
+
+        for (int slice = 1; slice < sliceCount; slice++)
+            mWorkers.emplace_back(&SliceConverter::workerLoop, this, slice);
+    }
+
+    SliceConverter::~SliceConverter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShutdown = true;
+        }
+        mWorkReady.notify_all();
+        for (std::thread &worker : mWorkers)
+            worker.join();
+    }
+
+    void SliceConverter::convert(const uint8_t *src, int srcStride,
+                                 uint8_t *const dst[3], const int dstStride[3],
+                                 int width, int height)
+    {
+        convert(src, srcStride, width, height, dst, dstStride, width, height);
+    }
+
+    void SliceConverter::convert(const uint8_t *src, int srcStride, int srcWidth, int srcHeight,
+                                 uint8_t *const dst[3], const int dstStride[3],
+                                 int width, int height, int64_t frame)
+    {
+        Job job{src, srcStride, srcWidth, srcHeight,
+                {dst[0], dst[1], dst[2]}, {dstStride[0], dstStride[1], dstStride[2]}, width, height, frame};
+        if (srcWidth != width || srcHeight != height)
+            mScaled.resize(static_cast<size_t>(width) * 4 * height);
+        if (mWorkers.empty())
+        {
+            mJob = job;
+            convertSlice(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJob = job;
+            mPending = static_cast<int>(mWorkers.size());
+            mGeneration++;
+        }
+        mWorkReady.notify_all();
+
+        convertSlice(0);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWorkDone.wait(lock, [this]
+                       { return mPending == 0; });
+    }
+
+    void SliceConverter::workerLoop(int slice)
+    {
+        FrameTracer::setThreadName("convert slice " + std::to_string(slice));
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mWorkReady.wait(lock, [this, seen]
+                            { return mShutdown || mGeneration != seen; });
+            if (mShutdown)
+                return;
+            seen = mGeneration;
+
+            lock.unlock();
+            convertSlice(slice);
+            lock.lock();
+
+            if (--mPending == 0)
+                mWorkDone.notify_one();
+        }
+    }
+
+    void SliceConverter::convertSlice(int slice)
+    {
+        TraceSpan span("slice", mJob.frame);
+        const Job &job = mJob;
+        int slices = sliceCount();
+        int sliceRows = evenRows((job.height + slices - 1) / slices);
+        int first = std::min(job.height, slice * sliceRows);
+        int last = std::min(job.height, first + sliceRows);
+        if (job.srcWidth != job.width || job.srcHeight != job.height)
+        {
+            scaleSlice(first, last);
+            return;
+        }
+
+        // 4 bytes per source pixel, 1.5 per output pixel
+        int blockRows = std::max(2, (kBlockBytes / std::max(1, job.width * 11 / 2)) & ~1);
+
+        for (int row = first; row < last; row += blockRows)
+        {
+            int rows = std::min(blockRows, last - row);
+            libyuv::ARGBToI420(
+                job.src + static_cast<size_t>(row) * job.srcStride, job.srcStride,
+                job.dst[0] + static_cast<size_t>(row) * job.dstStride[0], job.dstStride[0],
+                job.dst[1] + static_cast<size_t>(row / 2) * job.dstStride[1], job.dstStride[1],
+                job.dst[2] + static_cast<size_t>(row / 2) * job.dstStride[2], job.dstStride[2],
+                job.width, rows);
+        }
+    }
+
+    void SliceConverter::scaleSlice(int first, int last)
+    {
+        const Job &job = mJob;
+        // Each block of scaled BGRX rows is converted while still in cache
+        int scaledStride = job.width * 4;
+        int blockRows = std::max(2, (kBlockBytes / 2 / std::max(1, scaledStride)) & ~1);
+
+        // Box filtering averages every source pixel when shrinking; enlarging
+        // falls back to bilinear inside libyuv
+        for (int row = first; row < last; row += blockRows)
+        {
+            int rows = std::min(blockRows, last - row);
+            // ARGBScaleClip writes the clip rectangle at its place in the full frame
+            libyuv::ARGBScaleClip(job.src, job.srcStride, job.srcWidth, job.srcHeight,
+                                  mScaled.data(), scaledStride, job.width, job.height,
+                                  0, row, job.width, rows, libyuv::kFilterBox);
+            libyuv::ARGBToI420(
+                mScaled.data() + static_cast<size_t>(row) * scaledStride, scaledStride,
+                job.dst[0] + static_cast<size_t>(row) * job.dstStride[0], job.dstStride[0],
+                job.dst[1] + static_cast<size_t>(row / 2) * job.dstStride[1], job.dstStride[1],
+                job.dst[2] + static_cast<size_t>(row / 2) * job.dstStride[2], job.dstStride[2],
+                job.width, rows);
+        }
+    }
+}
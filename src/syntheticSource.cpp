@@ -0,0 +1,173 @@
+#include "syntheticSource.h"
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    constexpr int kGlyphWidth = 8;
+    constexpr int kGlyphHeight = 16;
+    constexpr int kGlyphCount = 64;
+    constexpr int kScrollPixelsPerFrame = 2;
+
+    uint32_t hash32(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352d;
+        x ^= x >> 15;
+        x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Fixed pseudo-random 8x16 bitmaps standing in for a font
+    const std::array<std::array<uint8_t, kGlyphHeight>, kGlyphCount> &glyphTable()
+    {
+        static const auto table = []()
+        {
+            std::array<std::array<uint8_t, kGlyphHeight>, kGlyphCount> glyphs{};
+            for (int g = 0; g < kGlyphCount; g++)
+            {
+                // Leave a blank margin above and below like real text
+                for (int row = 3; row < kGlyphHeight - 3; row++)
+                    glyphs[g][row] = hash32(g * kGlyphHeight + row) & 0x7E;
+            }
+            return glyphs;
+        }();
+        return table;
+    }
+
+    void writePixel(uint8_t *px, uint8_t r, uint8_t g, uint8_t b)
+    {
+        px[0] = b;
+        px[1] = g;
+        px[2] = r;
+        px[3] = 255;
+    }
+}
+
+namespace screen_recorder
+{
+    bool parseSyntheticPattern(const std::string &name, SyntheticPattern &pattern)
+    {
+        if (name == "text" || name == "scroll")
+            pattern = SyntheticPattern::ScrollingText;
+        else if (name == "noise" || name == "video")
+            pattern = SyntheticPattern::Noise;
+        else if (name == "static")
+            pattern = SyntheticPattern::Static;
+        else
+            return false;
+        return true;
+    }
+
+    SyntheticSource::SyntheticSource(SyntheticPattern pattern, int width, int height, int fps, bool realtime)
+        : mPattern(pattern), mWidth(width), mHeight(height), mFps(fps > 0 ? fps : 30), mRealtime(realtime)
+    {
+        if (mPattern == SyntheticPattern::Static)
+        {
+            // Every frame shares the one buffer, there is nothing to redraw
+            mStaticFrame = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(mWidth) * mHeight * 4);
+            renderStatic(mStaticFrame->data(), mWidth * 4);
+        }
+    }
+
+    std::shared_ptr<const Frame> SyntheticSource::grab(uint64_t index)
+    {
+        auto frame = std::make_shared<Frame>();
+        frame->width = mWidth;
+        frame->height = mHeight;
+        frame->format = PixelFormat::BGRX;
+        frame->stride[0] = mWidth * 4;
+        frame->timestampUs = static_cast<int64_t>(index * 1000000 / mFps);
+        frame->index = index;
+
+        std::shared_ptr<std::vector<uint8_t>> buffer = mStaticFrame;
+        if (!buffer)
+        {
+            buffer = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(mWidth) * mHeight * 4);
+            if (mPattern == SyntheticPattern::ScrollingText)
+                renderScrollingText(buffer->data(), frame->stride[0], index);
+            else
+                renderNoise(buffer->data(), frame->stride[0], index);
+        }
+        frame->data[0] = buffer->data();
+        frame->owner = buffer;
+        return frame;
+    }
+
+    void SyntheticSource::renderScrollingText(uint8_t *dst, int stride, uint64_t index) const
+    {
+        const auto &glyphs = glyphTable();
+        int columns = mWidth / kGlyphWidth;
+        uint64_t scroll = index * kScrollPixelsPerFrame;
+
+        for (int y = 0; y < mHeight; y++)
+        {
+            uint64_t absoluteRow = y + scroll;
+            uint32_t line = static_cast<uint32_t>(absoluteRow / kGlyphHeight);
+            int glyphRow = absoluteRow % kGlyphHeight;
+            uint32_t lineHash = hash32(line);
+            // Ragged right edge and the odd blank line, like a document
+            int lineLength = (lineHash % 7 == 0) ? 0 : static_cast<int>(lineHash % std::max(columns, 1));
+            uint8_t *row = dst + static_cast<size_t>(y) * stride;
+
+            for (int x = 0; x < mWidth; x++)
+                writePixel(row + x * 4, 250, 250, 245);
+
+            for (int column = 0; column < lineLength; column++)
+            {
+                uint32_t cellHash = hash32(lineHash ^ (column * 0x9E3779B9u));
+                if (cellHash % 6 == 0)
+                    continue; // word gap
+                uint8_t bits = glyphs[cellHash % kGlyphCount][glyphRow];
+                uint8_t *cell = row + column * kGlyphWidth * 4;
+                for (int bit = 0; bit < kGlyphWidth; bit++)
+                {
+                    if (bits & (0x80 >> bit))
+                        writePixel(cell + bit * 4, 30, 30, 40);
+                }
+            }
+        }
+    }
+
+    void SyntheticSource::renderNoise(uint8_t *dst, int stride, uint64_t index) const
+    {
+        uint32_t t = static_cast<uint32_t>(index);
+        for (int y = 0; y < mHeight; y++)
+        {
+            uint32_t state = hash32(t * 0x10001u + y) | 1;
+            uint8_t *row = dst + static_cast<size_t>(y) * stride;
+            for (int x = 0; x < mWidth; x++)
+            {
+                // xorshift grain on top of slowly drifting gradients
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                int grain = static_cast<int>(state & 31) - 16;
+                int r = ((x + t * 3) & 255) + grain;
+                int g = ((y + t * 2) & 255) + grain;
+                int b = (((x + y) / 2 + t) & 255) + grain;
+                writePixel(row + x * 4,
+                           static_cast<uint8_t>(std::clamp(r, 0, 255)),
+                           static_cast<uint8_t>(std::clamp(g, 0, 255)),
+                           static_cast<uint8_t>(std::clamp(b, 0, 255)));
+            }
+        }
+    }
+
+    void SyntheticSource::renderStatic(uint8_t *dst, int stride) const
+    {
+        static const uint8_t bars[8][3] = {
+            {235, 235, 235}, {235, 235, 16}, {16, 235, 235}, {16, 235, 16},
+            {235, 16, 235}, {235, 16, 16}, {16, 16, 235}, {16, 16, 16}};
+        for (int y = 0; y < mHeight; y++)
+        {
+            uint8_t *row = dst + static_cast<size_t>(y) * stride;
+            for (int x = 0; x < mWidth; x++)
+            {
+                const uint8_t *bar = bars[x * 8 / mWidth];
+                writePixel(row + x * 4, bar[0], bar[1], bar[2]);
+            }
+        }
+    }
+}
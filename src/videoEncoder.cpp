@@ -7,11 +7,19 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
+namespace
+{
+    // Everything in the x264 SPS/PPS that differs between the presets the
+    // load controller switches between (see loadController.cpp)
+    constexpr const char *kAdaptiveX264Params = "stitchable=1:cabac=1:8x8dct=1:ref=1:weightp=0:bframes=0";
+}
+
 namespace video_encoder
 {
     VideoEncoder::VideoEncoder()
-        : mFormatContext(nullptr), mCodecContext(nullptr), mVideoStream(nullptr),
-          mFrame(nullptr), mSwsContext(nullptr), mFrameIndex(0), mInitialized(false)
+        : mFormatContext(nullptr), mVideoStream(nullptr), mCodecContext(nullptr),
+          mFrame(nullptr), mSwsContext(nullptr), mPacket(nullptr), mCodec(nullptr),
+          mFrameIndex(0), mInitialized(false)
     {
     }
 
@@ -22,165 +30,288 @@ namespace video_encoder
 
     bool VideoEncoder::initialize(const std::string& filename, int width, int height, int fps, int bitrate)
     {
-        // Create output directory
-        std::filesystem::path outputDir = "out";
-        if (!std::filesystem::exists(outputDir))
+        EncoderSettings settings;
+        settings.width = width;
+        settings.height = height;
+        settings.fps = fps;
+        settings.bitrate = bitrate;
+        return initialize(filename, settings);
+    }
+
+    AVCodecContext *VideoEncoder::openCodec(const EncoderSettings &settings)
+    {
+        // Configure codec context
+        AVCodecContext *codecContext = avcodec_alloc_context3(mCodec);
+        if (!codecContext)
+            return nullptr;
+        codecContext->width = settings.width;
+        codecContext->height = settings.height;
+        codecContext->time_base = {1, settings.fps};
+        codecContext->framerate = {settings.fps, 1};
+        codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+        codecContext->thread_count = settings.threads;
+        if (settings.threadType == "frame")
+            codecContext->thread_type = FF_THREAD_FRAME;
+        else if (settings.threadType == "slice")
+            codecContext->thread_type = FF_THREAD_SLICE;
+
+        if (settings.crf >= 0)
         {
-            std::filesystem::create_directories(outputDir);
+            if (av_opt_set_int(codecContext->priv_data, "crf", settings.crf, 0) < 0)
+                std::cerr << "Encoder " << mCodec->name << " does not support crf" << std::endl;
+        }
+        else
+        {
+            codecContext->bit_rate = settings.bitrate;
         }
 
-        // Initialize format context
-        avformat_alloc_output_context2(&mFormatContext, nullptr, nullptr, ("out/" + filename).c_str());
-        if (!mFormatContext)
+        if (settings.adaptive)
         {
-            std::cerr << "Failed to create format context" << std::endl;
-            return false;
+            // Restarted encoders must keep dts monotonic, so no B-frames
+            codecContext->max_b_frames = 0;
         }
+        if (settings.globalHeader || (mFormatContext && (mFormatContext->oformat->flags & AVFMT_GLOBALHEADER)))
+            codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-        // Find H.264 encoder
-        const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-        if (!codec)
+        if (!settings.preset.empty() && av_opt_set(codecContext->priv_data, "preset", settings.preset.c_str(), 0) < 0)
+            std::cerr << "Encoder " << mCodec->name << " does not support preset " << settings.preset << std::endl;
+
+        if (settings.adaptive && std::string(mCodec->name) == "libx264")
         {
-            std::cerr << "H.264 codec not found" << std::endl;
-            return false;
+            // The container keeps the SPS/PPS of the first encoder only, so
+            // every preset on the ladder must produce the same ones: pin what
+            // the presets would vary there and keep x264 from tuning the
+            // headers to the content. Later presets then only change how
+            // hard the encoder searches.
+            av_opt_set(codecContext->priv_data, "profile", "high", 0);
+            if (av_opt_set(codecContext->priv_data, "x264-params", kAdaptiveX264Params, 0) < 0)
+                std::cerr << "Encoder " << mCodec->name << " cannot pin its stream headers" << std::endl;
         }
 
-        // Create video stream
-        mVideoStream = avformat_new_stream(mFormatContext, codec);
-        if (!mVideoStream)
+        // Open codec
+        if (avcodec_open2(codecContext, mCodec, nullptr) < 0)
         {
-            std::cerr << "Failed to create video stream" << std::endl;
-            return false;
+            std::cerr << "Failed to open codec" << std::endl;
+            avcodec_free_context(&codecContext);
+            return nullptr;
         }
+        return codecContext;
+    }
 
-        // Configure codec context
-        mCodecContext = avcodec_alloc_context3(codec);
-        mCodecContext->width = width;
-        mCodecContext->height = height;
-        mCodecContext->time_base = {1, fps};
-        mCodecContext->framerate = {fps, 1};
-        mCodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
-        mCodecContext->bit_rate = bitrate;
+    bool VideoEncoder::initialize(const std::string& filename, const EncoderSettings &settings)
+    {
+        finalize();
+        mSettings = settings;
 
-        if (mFormatContext->oformat->flags & AVFMT_GLOBALHEADER)
-            mCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (!filename.empty())
+        {
+            // Create output directory
+            std::filesystem::path outputDir = "out";
+            if (!std::filesystem::exists(outputDir))
+            {
+                std::filesystem::create_directories(outputDir);
+            }
 
-        // Open codec
-        if (avcodec_open2(mCodecContext, codec, nullptr) < 0)
+            // Initialize format context
+            avformat_alloc_output_context2(&mFormatContext, nullptr, nullptr, ("out/" + filename).c_str());
+            if (!mFormatContext)
+            {
+                std::cerr << "Failed to create format context" << std::endl;
+                return false;
+            }
+        }
+
+        // Find H.264 encoder unless another one was asked for
+        mCodec = mSettings.codec.empty() ? avcodec_find_encoder(AV_CODEC_ID_H264)
+                                         : avcodec_find_encoder_by_name(mSettings.codec.c_str());
+        if (!mCodec)
         {
-            std::cerr << "Failed to open codec" << std::endl;
+            std::cerr << (mSettings.codec.empty() ? "H.264" : mSettings.codec) << " codec not found" << std::endl;
+            finalize();
             return false;
         }
 
-        // Copy codec parameters to stream
-        avcodec_parameters_from_context(mVideoStream->codecpar, mCodecContext);
-
-        // Open output file
-        if (!(mFormatContext->oformat->flags & AVFMT_NOFILE))
+        if (mFormatContext)
         {
-            if (avio_open(&mFormatContext->pb, ("out/" + filename).c_str(), AVIO_FLAG_WRITE) < 0)
+            // Create video stream
+            mVideoStream = avformat_new_stream(mFormatContext, mCodec);
+            if (!mVideoStream)
             {
-                std::cerr << "Failed to open output file" << std::endl;
+                std::cerr << "Failed to create video stream" << std::endl;
+                finalize();
                 return false;
             }
         }
 
-        // Write header
-        if (avformat_write_header(mFormatContext, nullptr) < 0)
+        mCodecContext = openCodec(mSettings);
+        if (!mCodecContext)
         {
-            std::cerr << "Failed to write header" << std::endl;
+            finalize();
             return false;
         }
 
-        // Allocate frame
-        mFrame = av_frame_alloc();
-        mFrame->format = mCodecContext->pix_fmt;
-        mFrame->width = width;
-        mFrame->height = height;
-        av_frame_get_buffer(mFrame, 0);
+        if (mFormatContext)
+        {
+            // Copy codec parameters to stream
+            avcodec_parameters_from_context(mVideoStream->codecpar, mCodecContext);
 
-        // Create software scaler context
-        mSwsContext = sws_getContext(
-            width, height, AV_PIX_FMT_RGB24,
-            width, height, AV_PIX_FMT_YUV420P,
-            SWS_BICUBIC, nullptr, nullptr, nullptr);
+            // Open output file
+            if (!(mFormatContext->oformat->flags & AVFMT_NOFILE))
+            {
+                if (avio_open(&mFormatContext->pb, ("out/" + filename).c_str(), AVIO_FLAG_WRITE) < 0)
+                {
+                    std::cerr << "Failed to open output file" << std::endl;
+                    finalize();
+                    return false;
+                }
+            }
+
+            // Write header
+            if (avformat_write_header(mFormatContext, nullptr) < 0)
+            {
+                std::cerr << "Failed to write header" << std::endl;
+                finalize();
+                return false;
+            }
+        }
 
+        mPacket = av_packet_alloc();
+        mFrameIndex = 0;
         mInitialized = true;
         return true;
     }
 
+    void VideoEncoder::setPacketCallback(screen_recorder::PacketCallback callback)
+    {
+        mPacketCallback = std::move(callback);
+    }
+
+    bool VideoEncoder::drainPackets(AVCodecContext *codecContext)
+    {
+        // Packets are timestamped in the stream time base when muxing, or in
+        // the codec time base when there is no muxer.
+        AVRational packetTimeBase = mVideoStream ? mVideoStream->time_base : codecContext->time_base;
+
+        while (true)
+        {
+            int ret = avcodec_receive_packet(codecContext, mPacket);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                return true;
+            else if (ret < 0)
+            {
+                std::cerr << "Error during encoding" << std::endl;
+                return false;
+            }
+
+            av_packet_rescale_ts(mPacket, codecContext->time_base, packetTimeBase);
+            if (mPacketCallback)
+                mPacketCallback(mPacket, packetTimeBase.num, packetTimeBase.den);
+
+            if (mFormatContext)
+            {
+                mPacket->stream_index = mVideoStream->index;
+                av_interleaved_write_frame(mFormatContext, mPacket);
+            }
+            av_packet_unref(mPacket);
+        }
+    }
+
     bool VideoEncoder::encodeFrame(const uint8_t* rgb_buffer, int width, int height)
     {
         if (!mInitialized) return false;
 
+        if (!mFrame)
+        {
+            mFrame = av_frame_alloc();
+            mFrame->format = mCodecContext->pix_fmt;
+            mFrame->width = mSettings.width;
+            mFrame->height = mSettings.height;
+            av_frame_get_buffer(mFrame, 0);
+
+            // Create software scaler context
+            mSwsContext = sws_getContext(
+                width, height, AV_PIX_FMT_RGB24,
+                mSettings.width, mSettings.height, AV_PIX_FMT_YUV420P,
+                SWS_BICUBIC, nullptr, nullptr, nullptr);
+        }
+
         // Convert RGB to YUV420P
         const uint8_t* rgb_src[1] = {rgb_buffer};
         int rgb_linesize[1] = {width * 3};
 
+        av_frame_make_writable(mFrame);
         sws_scale(mSwsContext, rgb_src, rgb_linesize, 0, height,
                   mFrame->data, mFrame->linesize);
 
         mFrame->pts = mFrameIndex++;
+        return encodeFrame(mFrame);
+    }
 
-        // Encode frame
-        AVPacket* packet = av_packet_alloc();
-        if (!packet) return false;
+    bool VideoEncoder::encodeFrame(const AVFrame *frame)
+    {
+        if (!mInitialized) return false;
 
-        int ret = avcodec_send_frame(mCodecContext, mFrame);
-        if (ret < 0)
+        // Encode frame
+        if (avcodec_send_frame(mCodecContext, frame) < 0)
         {
-            av_packet_free(&packet);
+            std::cerr << "Error sending frame to encoder" << std::endl;
             return false;
         }
+        return drainPackets(mCodecContext);
+    }
 
-        while (ret >= 0)
+    bool VideoEncoder::reconfigure(const std::string &preset)
+    {
+        if (!mInitialized) return false;
+        if (!mSettings.adaptive)
         {
-            ret = avcodec_receive_packet(mCodecContext, packet);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                break;
-            else if (ret < 0)
-                break;
+            std::cerr << "Encoder was not opened for reconfiguration" << std::endl;
+            return false;
+        }
 
-            av_packet_rescale_ts(packet, mCodecContext->time_base, mVideoStream->time_base);
-            packet->stream_index = mVideoStream->index;
+        EncoderSettings settings = mSettings;
+        settings.preset = preset;
+        AVCodecContext *codecContext = openCodec(settings);
+        if (!codecContext)
+            return false;
 
-            av_interleaved_write_frame(mFormatContext, packet);
-            av_packet_unref(packet);
-        }
+        // Let the old encoder finish everything it has buffered first
+        avcodec_send_frame(mCodecContext, nullptr);
+        drainPackets(mCodecContext);
+        avcodec_free_context(&mCodecContext);
 
-        av_packet_free(&packet);
+        mCodecContext = codecContext;
+        mSettings = settings;
         return true;
     }
 
     void VideoEncoder::finalize()
     {
-        if (!mInitialized) return;
-
-        // Flush encoder
-        avcodec_send_frame(mCodecContext, nullptr);
-        AVPacket* packet = av_packet_alloc();
-        if (packet)
+        if (mInitialized)
         {
-            while (avcodec_receive_packet(mCodecContext, packet) == 0)
-            {
-                av_packet_rescale_ts(packet, mCodecContext->time_base, mVideoStream->time_base);
-                packet->stream_index = mVideoStream->index;
-                av_interleaved_write_frame(mFormatContext, packet);
-                av_packet_unref(packet);
-            }
-            av_packet_free(&packet);
-        }
+            // Flush encoder
+            avcodec_send_frame(mCodecContext, nullptr);
+            drainPackets(mCodecContext);
 
-        // Write trailer and cleanup
-        av_write_trailer(mFormatContext);
+            // Write trailer
+            if (mFormatContext)
+                av_write_trailer(mFormatContext);
+        }
 
+        if (mPacket) av_packet_free(&mPacket);
         if (mSwsContext) sws_freeContext(mSwsContext);
+        mSwsContext = nullptr;
         if (mFrame) av_frame_free(&mFrame);
         if (mCodecContext) avcodec_free_context(&mCodecContext);
-        if (!(mFormatContext->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&mFormatContext->pb);
-        if (mFormatContext) avformat_free_context(mFormatContext);
+        if (mFormatContext)
+        {
+            if (!(mFormatContext->oformat->flags & AVFMT_NOFILE) && mFormatContext->pb)
+                avio_closep(&mFormatContext->pb);
+            avformat_free_context(mFormatContext);
+            mFormatContext = nullptr;
+        }
+        mVideoStream = nullptr;
 
         mInitialized = false;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+#include "check.h"
+#include "activityMonitor.h"
+#include <cstring>
+#include <vector>
+
+using namespace screen_recorder;
+
+int main()
+{
+    // Odd width for the tail pixel, padded rows whose padding must not count
+    const int width = 1919;
+    const int height = 1080;
+    const int stride = width * 4 + 64;
+    std::vector<uint8_t> pixels(static_cast<size_t>(stride) * height, 50);
+    Frame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.format = PixelFormat::BGRX;
+    frame.data[0] = pixels.data();
+    frame.stride[0] = stride;
+    auto pixel = [&](int x, int y)
+    { return pixels.data() + static_cast<size_t>(y) * stride + x * 4; };
+
+    ActivityMonitor monitor(30, 1);
+    CHECK(monitor.tickStep() == 30);
+    CHECK(monitor.sample(frame)); // nothing to compare with yet
+    CHECK(!monitor.sample(frame));
+
+    // One pixel in a row the tile signature skips, and the last one in a row
+    pixel(500, 5)[0] = 9;
+    CHECK(monitor.sample(frame));
+    CHECK(!monitor.sample(frame));
+    pixel(width - 1, 7)[1] = 9;
+    CHECK(monitor.sample(frame));
+    pixel(width - 1, 8)[2] = 9;
+    CHECK(monitor.sample(frame));
+
+    // The X byte and the row padding are not content
+    pixel(100, 6)[3] = 9;
+    CHECK(!monitor.sample(frame));
+    pixels[static_cast<size_t>(9) * stride + width * 4] = 9;
+    CHECK(!monitor.sample(frame));
+
+    // Small changes are encoded but don't switch to the full rate: they
+    // touch two of the 510 tiles, below the 1% activity share
+    CHECK(!monitor.isActive());
+    CHECK(monitor.tickStep() == 30);
+
+    // A whole screen of new content does
+    std::memset(pixels.data(), 120, pixels.size());
+    CHECK(monitor.sample(frame));
+    CHECK(monitor.isActive());
+    CHECK(monitor.tickStep() == 1);
+
+    // A different size is always a change
+    frame.height = height / 2;
+    CHECK(monitor.sample(frame));
+    CHECK(!monitor.sample(frame));
+
+    return checkResult();
+}
@@ -0,0 +1,26 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// Minimal assertions for the unit checks: a failed CHECK is reported and
+// the test carries on, main() returns checkResult() for ctest.
+inline int gCheckFailures = 0;
+
+#define CHECK(condition)                                                                       \
+    do                                                                                         \
+    {                                                                                          \
+        if (!(condition))                                                                      \
+        {                                                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            gCheckFailures++;                                                                  \
+        }                                                                                      \
+    } while (0)
+
+inline int checkResult()
+{
+    if (gCheckFailures)
+        std::cerr << gCheckFailures << " check(s) failed" << std::endl;
+    return gCheckFailures ? 1 : 0;
+}
+#endif // CHECK_H
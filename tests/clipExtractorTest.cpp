@@ -0,0 +1,139 @@
+#include "check.h"
+#include "clipExtractor.h"
+#include "desktopCapturer.h"
+#include "keyframeIndex.h"
+#include "syntheticSource.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+using namespace screen_recorder;
+
+namespace
+{
+    constexpr int kFps = 30;
+
+    void checkIndexFile()
+    {
+        const std::string path = "keyframeIndexTest.idx";
+        CHECK(keyframeIndexPath("recording.ts") == "recording.ts.idx");
+
+        KeyframeIndexWriter writer;
+        CHECK(writer.open(path, 1, 90000));
+        CHECK(writer.append(0, 0, 0));
+        CHECK(writer.append(36000, 36000, 18800));
+        CHECK(writer.append(72000, 72000, 37600));
+        writer.close();
+
+        // An interrupted recording may leave half an entry behind
+        FILE *file = std::fopen(path.c_str(), "ab");
+        CHECK(file != nullptr);
+        if (file)
+        {
+            std::fputs("torn", file);
+            std::fclose(file);
+        }
+
+        KeyframeIndex index;
+        CHECK(index.load(path));
+        CHECK(index.header().timeBaseNum == 1 && index.header().timeBaseDen == 90000);
+        CHECK(index.entries().size() == 3);
+        CHECK(index.findAtOrBefore(-1) == nullptr);
+        CHECK(index.findAtOrBefore(0) && index.findAtOrBefore(0)->pts == 0);
+        CHECK(index.findAtOrBefore(50000) && index.findAtOrBefore(50000)->byteOffset == 18800);
+        CHECK(index.findAtOrBefore(72000) && index.findAtOrBefore(72000)->pts == 72000);
+        CHECK(index.findAtOrBefore(1000000) && index.findAtOrBefore(1000000)->pts == 72000);
+        std::remove(path.c_str());
+
+        KeyframeIndex garbage;
+        file = std::fopen(path.c_str(), "wb");
+        if (file)
+        {
+            std::fputs("not an index at all", file);
+            std::fclose(file);
+        }
+        CHECK(!garbage.load(path));
+        std::remove(path.c_str());
+    }
+
+    // Video packets of a file, and whether the first one is a keyframe
+    int countPackets(const std::string &path, bool &startsOnKeyframe)
+    {
+        startsOnKeyframe = false;
+        AVFormatContext *context = nullptr;
+        if (avformat_open_input(&context, path.c_str(), nullptr, nullptr) < 0)
+            return -1;
+        int packets = 0;
+        AVPacket *packet = av_packet_alloc();
+        while (av_read_frame(context, packet) >= 0)
+        {
+            if (packets++ == 0)
+                startsOnKeyframe = packet->flags & AV_PKT_FLAG_KEY;
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        avformat_close_input(&context);
+        return packets;
+    }
+
+    // Records a few seconds and cuts [1.5 s, 2.5 s) out of them
+    void checkClip(const std::string &name)
+    {
+        std::cout << "Clip from " << name << std::endl;
+        const std::string recording = "out/" + name;
+        const std::string clip = "out/clip-" + name;
+        {
+            DesktopCapture capture(false);
+            capture.startCapture(std::make_unique<SyntheticSource>(SyntheticPattern::Noise, 320, 240, kFps),
+                                 name, kFps, 4);
+        }
+        CHECK(std::filesystem::exists(recording));
+
+        KeyframeIndex index;
+        CHECK(index.load(keyframeIndexPath(recording)));
+        CHECK(index.entries().size() >= 2);
+        if (index.entries().empty())
+            return;
+
+        // The clip runs from the keyframe at or before the start to the end
+        double timeBase = static_cast<double>(index.header().timeBaseNum) / index.header().timeBaseDen;
+        const KeyframeIndexEntry *keyframe = index.findAtOrBefore(std::llround(1.5 / timeBase));
+        CHECK(keyframe != nullptr);
+        if (!keyframe)
+            return;
+        int expected = static_cast<int>(std::lround((2.5 - keyframe->pts * timeBase) * kFps));
+
+        CHECK(extractClip(recording, 1.5, 2.5, clip));
+        bool startsOnKeyframe = false;
+        int packets = countPackets(clip, startsOnKeyframe);
+        std::cout << "  " << packets << " packets, " << expected << " expected" << std::endl;
+        CHECK(startsOnKeyframe);
+        // Reordered frames may add a couple past the end
+        CHECK(packets >= expected && packets <= expected + 3);
+
+        // Without the index the demuxer's own seek has to get there too
+        std::filesystem::remove(keyframeIndexPath(recording));
+        CHECK(extractClip(recording, 1.5, 2.5, clip));
+        packets = countPackets(clip, startsOnKeyframe);
+        CHECK(startsOnKeyframe);
+        CHECK(packets >= kFps && packets <= expected + kFps);
+
+        CHECK(!extractClip(recording, 2.5, 1.5, clip));
+    }
+}
+
+int main()
+{
+    checkIndexFile();
+    // MPEG-TS seeks by the indexed byte offset and starts its timestamps at
+    // the mux delay; MP4 seeks by the indexed timestamp
+    checkClip("clipExtractorTest.ts");
+    checkClip("clipExtractorTest.mp4");
+    return checkResult();
+}
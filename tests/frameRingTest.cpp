@@ -0,0 +1,107 @@
+#include "check.h"
+#include "frameRing.h"
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace screen_recorder;
+
+namespace
+{
+    // BGRX frame whose every byte is `value`
+    Frame makeFrame(std::vector<uint8_t> &pixels, int width, int height, uint8_t value, uint64_t index)
+    {
+        pixels.assign(static_cast<size_t>(width) * height * 4, value);
+        Frame frame;
+        frame.width = width;
+        frame.height = height;
+        frame.format = PixelFormat::BGRX;
+        frame.data[0] = pixels.data();
+        frame.stride[0] = width * 4;
+        frame.index = index;
+        return frame;
+    }
+
+    bool rowsEqual(const Frame &frame, uint8_t value)
+    {
+        for (int y = 0; y < frame.height; y++)
+        {
+            const uint8_t *row = frame.data[0] + static_cast<size_t>(y) * frame.stride[0];
+            for (int x = 0; x < frame.width * 4; x++)
+            {
+                if (row[x] != value)
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    const std::string name = "screencapture-test-" + std::to_string(getpid());
+    const int slots = 3;
+    std::vector<uint8_t> pixels;
+
+    FrameRingWriter writer(name, PixelFormat::BGRX, slots);
+    CHECK(writer.isOpen());
+    {
+        // The name stays claimed; a second writer must not take it over
+        FrameRingWriter intruder(name, PixelFormat::BGRX, slots);
+        CHECK(!intruder.isOpen());
+    }
+
+    FrameRingReader reader;
+    CHECK(!reader.open(name)); // nothing published yet, not a ring
+
+    CHECK(writer.publish(makeFrame(pixels, 64, 32, 1, 1)));
+    CHECK(reader.open(name));
+
+    FrameRingView first;
+    CHECK(reader.acquireLatest(first));
+    CHECK(first.sequence == 1);
+    CHECK(first.frame.width == 64 && first.frame.height == 32);
+    CHECK(first.frame.index == 1);
+    CHECK(rowsEqual(first.frame, 1));
+    CHECK(reader.isValid(first));
+
+    FrameRingView view;
+    CHECK(!reader.acquireLatest(view, first.sequence)); // nothing newer
+
+    // Once the producer wraps around to the slot, the old view is stale
+    for (int i = 2; i <= slots; i++)
+        CHECK(writer.publish(makeFrame(pixels, 64, 32, static_cast<uint8_t>(i), i)));
+    CHECK(reader.isValid(first));
+    CHECK(writer.publish(makeFrame(pixels, 64, 32, 9, slots + 1)));
+    CHECK(!reader.isValid(first));
+
+    CHECK(reader.acquireLatest(view, first.sequence));
+    CHECK(view.sequence == static_cast<uint64_t>(slots + 1));
+    CHECK(rowsEqual(view.frame, 9));
+
+    // Smaller frames fit the slots sized for the first one
+    CHECK(writer.publish(makeFrame(pixels, 32, 16, 5, slots + 2)));
+    CHECK(reader.acquireLatest(view, view.sequence));
+    CHECK(view.frame.width == 32 && rowsEqual(view.frame, 5));
+
+    // A larger one ends the export and releases the name
+    CHECK(!writer.publish(makeFrame(pixels, 128, 64, 7, slots + 3)));
+    CHECK(!writer.isOpen());
+    FrameRingReader late;
+    CHECK(!late.open(name));
+
+    // A writer whose name was removed and claimed again must not unlink
+    // the new owner's ring when it closes
+    FrameRingWriter stale(name, PixelFormat::BGRX, slots);
+    CHECK(stale.isOpen());
+    shm_unlink(("/" + name).c_str());
+    FrameRingWriter owner(name, PixelFormat::BGRX, slots);
+    CHECK(owner.isOpen());
+    CHECK(owner.publish(makeFrame(pixels, 16, 16, 3, 1)));
+    stale.close();
+    CHECK(late.open(name));
+
+    return checkResult();
+}
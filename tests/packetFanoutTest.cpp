@@ -0,0 +1,183 @@
+#include "check.h"
+#include "packetFanout.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace screen_recorder;
+
+namespace
+{
+    constexpr int kPackets = 600;
+    constexpr int kGop = 30;
+
+    // Records the pts and key flag of every packet it is handed
+    class RecordingSink : public PacketSink
+    {
+    public:
+        RecordingSink(const char *name, std::chrono::microseconds delay, bool failWrites = false)
+            : mName(name), mDelay(delay), mFailWrites(failWrites) {}
+
+        std::string name() const override { return mName; }
+        bool open(const AVCodecParameters *, AVRational) override { return true; }
+        bool write(const std::shared_ptr<const AVPacket> &packet) override
+        {
+            std::this_thread::sleep_for(mDelay);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPts.push_back(packet->pts);
+            mKey.push_back(packet->flags & AV_PKT_FLAG_KEY);
+            return !mFailWrites;
+        }
+        void close() override { mClosed = true; }
+
+        std::vector<int64_t> mPts;
+        std::vector<bool> mKey;
+        std::atomic<bool> mClosed{false};
+
+    private:
+        const char *mName;
+        std::chrono::microseconds mDelay;
+        bool mFailWrites;
+        std::mutex mMutex;
+    };
+
+    // Blocks in write until aborted, or for `hold` if it ignores abort()
+    class BlockingSink : public PacketSink
+    {
+    public:
+        BlockingSink(bool honourAbort, std::chrono::milliseconds hold) : mHonourAbort(honourAbort), mHold(hold) {}
+
+        std::string name() const override { return mHonourAbort ? "blocking" : "stuck"; }
+        bool open(const AVCodecParameters *, AVRational) override { return true; }
+        bool write(const std::shared_ptr<const AVPacket> &) override
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mAborted.wait_for(lock, mHold, [this]
+                              { return mHonourAbort && mAbortCalled; });
+            return !mAbortCalled;
+        }
+        void close() override { mClosed = true; }
+        void abort() override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mAbortCalled = true;
+            mAborted.notify_all();
+        }
+
+        bool mAbortCalled = false;
+        std::atomic<bool> mClosed{false};
+
+    private:
+        bool mHonourAbort;
+        std::chrono::milliseconds mHold;
+        std::mutex mMutex;
+        std::condition_variable mAborted;
+    };
+
+    void pushAll(PacketFanout &fanout)
+    {
+        AVPacket *packet = av_packet_alloc();
+        for (int i = 0; i < kPackets; i++)
+        {
+            packet->pts = packet->dts = i;
+            packet->flags = i % kGop == 0 ? AV_PKT_FLAG_KEY : 0;
+            fanout.push(packet);
+        }
+        av_packet_free(&packet);
+    }
+
+    long long millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main()
+{
+    AVCodecContext *codecContext = avcodec_alloc_context3(nullptr);
+    codecContext->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecContext->time_base = {1, 30};
+
+    {
+        // Both sinks are slower than the producer; a queue of 4 lets the
+        // lossless one buffer 64 packets and then holds push() back
+        auto recording = std::make_shared<RecordingSink>("recording", std::chrono::microseconds(200));
+        auto live = std::make_shared<RecordingSink>("live", std::chrono::microseconds(200));
+        auto failing = std::make_shared<RecordingSink>("failing", std::chrono::microseconds(0), true);
+        PacketFanout fanout(4);
+        fanout.addSink(recording, true);
+        fanout.addSink(live);
+        fanout.addSink(failing);
+        fanout.start(codecContext);
+        pushAll(fanout);
+        fanout.stop();
+
+        // Lossless: every packet, in order
+        CHECK(recording->mPts.size() == static_cast<size_t>(kPackets));
+        bool ordered = true;
+        for (size_t i = 0; i < recording->mPts.size(); i++)
+            ordered = ordered && recording->mPts[i] == static_cast<int64_t>(i);
+        CHECK(ordered);
+        CHECK(recording->mClosed);
+
+        // Live: drops, but picks up again only on a keyframe
+        CHECK(!live->mPts.empty());
+        CHECK(live->mPts.size() < static_cast<size_t>(kPackets));
+        CHECK(!live->mPts.empty() && live->mKey.front());
+        bool resumesOnKeyframe = true;
+        for (size_t i = 1; i < live->mPts.size(); i++)
+        {
+            if (live->mPts[i] != live->mPts[i - 1] + 1)
+                resumesOnKeyframe = resumesOnKeyframe && live->mKey[i];
+        }
+        CHECK(resumesOnKeyframe);
+        CHECK(live->mClosed);
+
+        // A failed sink is dropped after its first write, the others carry on
+        CHECK(failing->mPts.size() == 1);
+        CHECK(failing->mClosed);
+    }
+
+    {
+        // Stuck past the timeout: aborted, and stop() returns once it gives up
+        auto blocking = std::make_shared<BlockingSink>(true, std::chrono::milliseconds(10000));
+        PacketFanout fanout;
+        fanout.addSink(blocking);
+        fanout.start(codecContext);
+        pushAll(fanout);
+        auto start = std::chrono::steady_clock::now();
+        fanout.stop(200);
+        long long elapsed = millisecondsSince(start);
+        std::cout << "Aborted sink stopped after " << elapsed << " ms" << std::endl;
+        CHECK(blocking->mAbortCalled);
+        CHECK(blocking->mClosed);
+        CHECK(elapsed < 1000);
+    }
+
+    {
+        // Ignores abort(): left behind, stop() is still bounded
+        auto stuck = std::make_shared<BlockingSink>(false, std::chrono::milliseconds(2500));
+        auto start = std::chrono::steady_clock::now();
+        {
+            PacketFanout fanout;
+            fanout.addSink(stuck);
+            fanout.start(codecContext);
+            pushAll(fanout);
+            fanout.stop(200);
+        }
+        long long elapsed = millisecondsSince(start);
+        std::cout << "Stuck sink left behind after " << elapsed << " ms" << std::endl;
+        CHECK(stuck->mAbortCalled);
+        CHECK(elapsed < 2000);
+        // The detached thread still finishes on its own
+        while (!stuck->mClosed && millisecondsSince(start) < 10000)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(stuck->mClosed);
+    }
+
+    avcodec_free_context(&codecContext);
+    return checkResult();
+}
@@ -0,0 +1,135 @@
+#include "check.h"
+#include "pixelUnpack.h"
+#include <X11/Xutil.h>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    struct Layout
+    {
+        const char *name;
+        int bitsPerPixel;
+        int depth;
+        unsigned long redMask;
+        unsigned long greenMask;
+        unsigned long blueMask;
+        bool native; // expected for LSBFirst
+    };
+
+    const Layout kLayouts[] = {
+        {"rgb565", 16, 16, 0xF800, 0x07E0, 0x001F, false},
+        {"bgr565", 16, 16, 0x001F, 0x07E0, 0xF800, false},
+        {"xrgb8888", 32, 24, 0xFF0000, 0x00FF00, 0x0000FF, true},
+        {"xbgr8888", 32, 24, 0x0000FF, 0x00FF00, 0xFF0000, false},
+        {"xrgb2101010", 32, 30, 0x3FF00000, 0x000FFC00, 0x000003FF, false},
+        {"xbgr2101010", 32, 30, 0x000003FF, 0x000FFC00, 0x3FF00000, false},
+        {"rgb888", 24, 24, 0xFF0000, 0x00FF00, 0x0000FF, false},
+        {"bgr888", 24, 24, 0x0000FF, 0x00FF00, 0xFF0000, false},
+    };
+
+    // A client-side image, no display needed
+    XImage *createImage(const Layout &layout, int byteOrder, int width, int height)
+    {
+        auto *image = static_cast<XImage *>(std::calloc(1, sizeof(XImage)));
+        image->width = width;
+        image->height = height;
+        image->format = ZPixmap;
+        image->depth = layout.depth;
+        image->bits_per_pixel = layout.bitsPerPixel;
+        image->red_mask = layout.redMask;
+        image->green_mask = layout.greenMask;
+        image->blue_mask = layout.blueMask;
+        image->byte_order = byteOrder;
+        image->bitmap_unit = 32;
+        image->bitmap_pad = 32;
+        image->bitmap_bit_order = MSBFirst;
+        // Padded rows, so a fast path that ignores the stride shows up
+        image->bytes_per_line = (width * layout.bitsPerPixel / 8 + 3 + 16) & ~3;
+        image->data = static_cast<char *>(std::calloc(image->bytes_per_line, height));
+        XInitImage(image);
+        return image;
+    }
+
+    // Colour channels within one step of the reference; the X byte is unspecified
+    bool closeEnough(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, int width, int height)
+    {
+        for (int i = 0; i < width * height; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                if (std::abs(a[i * 4 + c] - b[i * 4 + c]) > 1)
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    const int width = 37; // odd, so SIMD tails are covered
+    const int height = 5;
+    std::mt19937 generator(42);
+
+    for (const Layout &layout : kLayouts)
+    {
+        for (int byteOrder : {LSBFirst, MSBFirst})
+        {
+            XImage *image = createImage(layout, byteOrder, width, height);
+            unsigned long allBits = layout.redMask | layout.greenMask | layout.blueMask;
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    // Pure channels first, then random pixels
+                    unsigned long pixel = x == 0   ? layout.redMask
+                                          : x == 1 ? layout.greenMask
+                                          : x == 2 ? layout.blueMask
+                                          : x == 3 ? 0
+                                                   : generator() & allBits;
+                    XPutPixel(image, x, y, pixel);
+                }
+            }
+
+            pixel_unpack::Unpacker unpacker = pixel_unpack::selectUnpacker(image);
+            std::cout << layout.name << (byteOrder == LSBFirst ? " lsb" : " msb") << ": " << unpacker.name << std::endl;
+            // 24bpp layouts are named by their order in memory
+            const char *expectedName = layout.name;
+            if (layout.bitsPerPixel == 24 && byteOrder == LSBFirst)
+                expectedName = layout.redMask == 0xFF0000 ? "bgr888" : "rgb888";
+            CHECK(std::strcmp(unpacker.name, expectedName) == 0);
+            CHECK(unpacker.unpack != nullptr);
+            CHECK(unpacker.native == (layout.native && byteOrder == LSBFirst));
+
+            std::vector<uint8_t> expected(width * height * 4), actual(width * height * 4);
+            pixel_unpack::genericUnpack(image, expected.data(), width * 4, width, height);
+            // Full scale must stay full scale
+            CHECK(expected[2] == 255 && expected[0] == 0 && expected[1] == 0);
+            CHECK(expected[5] == 255 && expected[4] == 0 && expected[6] == 0);
+            CHECK(expected[8] == 255 && expected[9] == 0 && expected[10] == 0);
+            CHECK(expected[12] == 0 && expected[13] == 0 && expected[14] == 0);
+
+            if (unpacker.unpack)
+            {
+                unpacker.unpack(reinterpret_cast<const uint8_t *>(image->data), image->bytes_per_line,
+                                actual.data(), width * 4, width, height);
+                CHECK(closeEnough(actual, expected, width, height));
+            }
+            if (unpacker.native)
+            {
+                // Used as is: the memory must already read as BGRX
+                for (int y = 0; y < height; y++)
+                {
+                    std::memcpy(actual.data() + y * width * 4, image->data + y * image->bytes_per_line, width * 4);
+                }
+                CHECK(closeEnough(actual, expected, width, height));
+            }
+            XDestroyImage(image);
+        }
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,446 @@
+// Encodes one frame sequence across a grid of encoder settings and reports
+// speed, CPU cost, memory, size and quality for each, as CSV and/or JSON.
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <libyuv.h>
+#include "frameSource.h"
+#include "videoEncoder.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace
+{
+    struct Options
+    {
+        std::string source = "synthetic:text:1920x1080@30";
+        int frames = 300;
+        std::vector<std::string> codecs = {"libx264"};
+        std::vector<std::string> presets = {"ultrafast", "veryfast", "medium"};
+        std::vector<std::string> crfs;
+        std::vector<std::string> bitrates = {"2000000"};
+        std::vector<std::string> threads = {"0"};
+        std::vector<std::string> threadTypes = {"frame"};
+        std::string csv;
+        std::string json;
+    };
+
+    struct Result
+    {
+        video_encoder::EncoderSettings settings;
+        bool ok = false;
+        int frames = 0;
+        double encodeFps = 0;
+        double cpuMsPerFrame = 0;
+        long peakRssKb = 0;
+        uint64_t outputBytes = 0;
+        double psnr = 0;
+        double ssim = 0;
+    };
+
+    // Source frame converted to the encoder's input format
+    struct YuvFrame
+    {
+        std::vector<uint8_t> data;
+        uint8_t *plane[3];
+        int stride[3];
+
+        YuvFrame(int width, int height)
+            : data(static_cast<size_t>(width) * height * 3 / 2)
+        {
+            stride[0] = width;
+            stride[1] = stride[2] = width / 2;
+            plane[0] = data.data();
+            plane[1] = plane[0] + static_cast<size_t>(width) * height;
+            plane[2] = plane[1] + static_cast<size_t>(width / 2) * (height / 2);
+        }
+    };
+
+    void printUsage(const char *program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+                  << "  --source <spec>       synthetic:<text|noise|static>:<W>x<H>[@fps] or replay:<file>\n"
+                  << "                        (default: synthetic:text:1920x1080@30)\n"
+                  << "  --frames <n>          frames encoded per setting (default: 300)\n"
+                  << "  --codec <a,b,...>     encoder names (default: libx264)\n"
+                  << "  --preset <a,b,...>    presets (default: ultrafast,veryfast,medium)\n"
+                  << "  --crf <a,b,...>       constant quality values, each one a grid point\n"
+                  << "  --bitrate <a,b,...>   bitrates in bit/s (default: 2000000 unless --crf is given)\n"
+                  << "  --threads <a,b,...>   encoder thread counts, 0 = automatic (default: 0)\n"
+                  << "  --thread-type <a,..>  frame and/or slice (default: frame)\n"
+                  << "  --csv <file>          write CSV here (default: stdout unless --json is given)\n"
+                  << "  --json <file>         write JSON here" << std::endl;
+    }
+
+    std::vector<std::string> splitList(const std::string &list)
+    {
+        std::vector<std::string> values;
+        std::stringstream stream(list);
+        std::string value;
+        while (std::getline(stream, value, ','))
+        {
+            if (!value.empty())
+                values.push_back(value);
+        }
+        return values;
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        bool bitratesGiven = false;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--source" && hasValue)
+                options.source = argv[++i];
+            else if (arg == "--frames" && hasValue)
+                options.frames = std::stoi(argv[++i]);
+            else if (arg == "--codec" && hasValue)
+                options.codecs = splitList(argv[++i]);
+            else if (arg == "--preset" && hasValue)
+                options.presets = splitList(argv[++i]);
+            else if (arg == "--crf" && hasValue)
+                options.crfs = splitList(argv[++i]);
+            else if (arg == "--bitrate" && hasValue)
+            {
+                options.bitrates = splitList(argv[++i]);
+                bitratesGiven = true;
+            }
+            else if (arg == "--threads" && hasValue)
+                options.threads = splitList(argv[++i]);
+            else if (arg == "--thread-type" && hasValue)
+                options.threadTypes = splitList(argv[++i]);
+            else if (arg == "--csv" && hasValue)
+                options.csv = argv[++i];
+            else if (arg == "--json" && hasValue)
+                options.json = argv[++i];
+            else
+                return false;
+        }
+        // With only --crf the default bitrate point would just be noise
+        if (!options.crfs.empty() && !bitratesGiven)
+            options.bitrates.clear();
+        return options.frames > 0 && !options.codecs.empty() && !options.presets.empty() &&
+               !(options.crfs.empty() && options.bitrates.empty()) &&
+               !options.threads.empty() && !options.threadTypes.empty();
+    }
+
+    std::vector<video_encoder::EncoderSettings> buildGrid(const Options &options, int width, int height, int fps)
+    {
+        // Rate control is one axis: each crf and each bitrate is a point on it
+        std::vector<std::pair<int, int>> rates; // crf, bitrate
+        for (const std::string &crf : options.crfs)
+            rates.emplace_back(std::stoi(crf), 0);
+        for (const std::string &bitrate : options.bitrates)
+            rates.emplace_back(-1, std::stoi(bitrate));
+
+        std::vector<video_encoder::EncoderSettings> grid;
+        for (const std::string &codec : options.codecs)
+            for (const std::string &preset : options.presets)
+                for (const auto &rate : rates)
+                    for (const std::string &threads : options.threads)
+                        for (const std::string &threadType : options.threadTypes)
+                        {
+                            video_encoder::EncoderSettings settings;
+                            settings.width = width;
+                            settings.height = height;
+                            settings.fps = fps;
+                            settings.codec = codec;
+                            settings.preset = preset;
+                            settings.crf = rate.first;
+                            if (rate.second > 0)
+                                settings.bitrate = rate.second;
+                            settings.threads = std::stoi(threads);
+                            settings.threadType = threadType;
+                            grid.push_back(settings);
+                        }
+        return grid;
+    }
+
+    double processCpuMs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+    }
+
+    double threadCpuMs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+    }
+
+    // Restarts the kernel's peak RSS tracking so each setting gets its own
+    // high-water mark. Returns false where that is unsupported.
+    bool resetPeakRss()
+    {
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        clearRefs << "5";
+        return static_cast<bool>(clearRefs.flush());
+    }
+
+    long peakRssKb(bool resetWorked)
+    {
+        if (resetWorked)
+        {
+            std::ifstream status("/proc/self/status");
+            std::string line;
+            while (std::getline(status, line))
+            {
+                if (line.rfind("VmHWM:", 0) == 0)
+                    return std::stol(line.substr(6));
+            }
+        }
+        // Process lifetime peak, only an upper bound for this setting
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    bool loadFrame(screen_recorder::FrameSource &source, uint64_t index, uint8_t *const plane[3], const int stride[3],
+                   int width, int height)
+    {
+        std::shared_ptr<const screen_recorder::Frame> frame = source.grab(index);
+        if (!frame)
+            return false;
+        libyuv::ARGBToI420(frame->data[0], frame->stride[0],
+                           plane[0], stride[0], plane[1], stride[1], plane[2], stride[2],
+                           width, height);
+        return true;
+    }
+
+    Result runSetting(screen_recorder::FrameSource &source, const video_encoder::EncoderSettings &settings, int frameCount)
+    {
+        Result result;
+        result.settings = settings;
+        int width = settings.width, height = settings.height;
+
+        // Pass 1: encode only, keeping the packets for the quality pass
+        bool rssReset = resetPeakRss();
+        std::vector<AVPacket *> packets;
+        video_encoder::VideoEncoder encoder;
+        encoder.setPacketCallback([&](const AVPacket *packet, int, int)
+                                  {
+                                      result.outputBytes += packet->size;
+                                      packets.push_back(av_packet_clone(packet));
+                                  });
+        if (!encoder.initialize("", settings))
+            return result;
+
+        AVFrame *frame = av_frame_alloc();
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = width;
+        frame->height = height;
+        av_frame_get_buffer(frame, 0);
+
+        // Grabbing and converting source frames is not the encoder's cost;
+        // it runs on this thread, so its CPU and wall time are taken out
+        double sourceCpuMs = 0;
+        std::chrono::duration<double, std::milli> sourceWall{0};
+        double cpuStart = processCpuMs();
+        auto wallStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < frameCount; i++)
+        {
+            double cpuBefore = threadCpuMs();
+            auto wallBefore = std::chrono::steady_clock::now();
+            av_frame_make_writable(frame);
+            if (!loadFrame(source, i, frame->data, frame->linesize, width, height))
+                break;
+            frame->pts = i;
+            sourceCpuMs += threadCpuMs() - cpuBefore;
+            sourceWall += std::chrono::steady_clock::now() - wallBefore;
+
+            encoder.encodeFrame(frame);
+            result.frames++;
+        }
+        encoder.finalize();
+        double encodeCpuMs = processCpuMs() - cpuStart - sourceCpuMs;
+        std::chrono::duration<double, std::milli> encodeWall = std::chrono::steady_clock::now() - wallStart - sourceWall;
+        result.peakRssKb = peakRssKb(rssReset);
+        av_frame_free(&frame);
+
+        if (result.frames == 0)
+        {
+            for (AVPacket *packet : packets)
+                av_packet_free(&packet);
+            return result;
+        }
+        result.encodeFps = result.frames / (encodeWall.count() / 1000.0);
+        result.cpuMsPerFrame = encodeCpuMs / result.frames;
+
+        // Pass 2: decode and compare with the source frames
+        const AVCodec *decoder = avcodec_find_decoder(encoder.codec()->id);
+        AVCodecContext *decoderContext = decoder ? avcodec_alloc_context3(decoder) : nullptr;
+        if (!decoderContext || avcodec_open2(decoderContext, decoder, nullptr) < 0)
+        {
+            std::cerr << "No decoder for " << encoder.codec()->name << ", skipping quality metrics" << std::endl;
+            avcodec_free_context(&decoderContext);
+            for (AVPacket *packet : packets)
+                av_packet_free(&packet);
+            result.ok = true;
+            return result;
+        }
+
+        AVFrame *decoded = av_frame_alloc();
+        YuvFrame yuv(width, height);
+        int compared = 0;
+        auto compareDecoded = [&]()
+        {
+            while (avcodec_receive_frame(decoderContext, decoded) == 0)
+            {
+                int64_t index = decoded->best_effort_timestamp != AV_NOPTS_VALUE ? decoded->best_effort_timestamp : decoded->pts;
+                if (decoded->format == AV_PIX_FMT_YUV420P && index >= 0 && loadFrame(source, index, yuv.plane, yuv.stride, width, height))
+                {
+                    result.psnr += libyuv::I420Psnr(yuv.plane[0], yuv.stride[0], yuv.plane[1], yuv.stride[1], yuv.plane[2], yuv.stride[2],
+                                                    decoded->data[0], decoded->linesize[0], decoded->data[1], decoded->linesize[1],
+                                                    decoded->data[2], decoded->linesize[2], width, height);
+                    result.ssim += libyuv::I420Ssim(yuv.plane[0], yuv.stride[0], yuv.plane[1], yuv.stride[1], yuv.plane[2], yuv.stride[2],
+                                                    decoded->data[0], decoded->linesize[0], decoded->data[1], decoded->linesize[1],
+                                                    decoded->data[2], decoded->linesize[2], width, height);
+                    compared++;
+                }
+                av_frame_unref(decoded);
+            }
+        };
+        for (AVPacket *packet : packets)
+        {
+            avcodec_send_packet(decoderContext, packet);
+            compareDecoded();
+            av_packet_free(&packet);
+        }
+        avcodec_send_packet(decoderContext, nullptr);
+        compareDecoded();
+        av_frame_free(&decoded);
+        avcodec_free_context(&decoderContext);
+
+        if (compared > 0)
+        {
+            result.psnr /= compared;
+            result.ssim /= compared;
+        }
+        result.ok = true;
+        return result;
+    }
+
+    std::string rateControl(const video_encoder::EncoderSettings &settings)
+    {
+        return settings.crf >= 0 ? "crf" + std::to_string(settings.crf) : std::to_string(settings.bitrate) + "bps";
+    }
+
+    void writeCsv(std::ostream &out, const std::vector<Result> &results, int fps)
+    {
+        out << "codec,preset,rate_control,threads,thread_type,frames,encode_fps,cpu_ms_per_frame,"
+               "peak_rss_kb,output_bytes,bitrate_kbps,psnr_db,ssim,status\n";
+        for (const Result &r : results)
+        {
+            double kbps = r.frames ? r.outputBytes * 8.0 * fps / r.frames / 1000.0 : 0;
+            out << r.settings.codec << ',' << r.settings.preset << ',' << rateControl(r.settings) << ','
+                << r.settings.threads << ',' << r.settings.threadType << ',' << r.frames << ','
+                << r.encodeFps << ',' << r.cpuMsPerFrame << ',' << r.peakRssKb << ',' << r.outputBytes << ','
+                << kbps << ',' << r.psnr << ',' << r.ssim << ',' << (r.ok ? "ok" : "failed") << '\n';
+        }
+    }
+
+    // Grid values come from the command line; same rules as the trace writer
+    std::string jsonEscape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+
+    void writeJson(std::ostream &out, const std::vector<Result> &results, int fps)
+    {
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result &r = results[i];
+            double kbps = r.frames ? r.outputBytes * 8.0 * fps / r.frames / 1000.0 : 0;
+            out << "  {\"codec\": \"" << jsonEscape(r.settings.codec) << "\", \"preset\": \"" << jsonEscape(r.settings.preset)
+                << "\", \"rate_control\": \"" << jsonEscape(rateControl(r.settings)) << "\", \"threads\": " << r.settings.threads
+                << ", \"thread_type\": \"" << jsonEscape(r.settings.threadType) << "\", \"frames\": " << r.frames
+                << ", \"encode_fps\": " << r.encodeFps << ", \"cpu_ms_per_frame\": " << r.cpuMsPerFrame
+                << ", \"peak_rss_kb\": " << r.peakRssKb << ", \"output_bytes\": " << r.outputBytes
+                << ", \"bitrate_kbps\": " << kbps << ", \"psnr_db\": " << r.psnr << ", \"ssim\": " << r.ssim
+                << ", \"ok\": " << (r.ok ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        if (!parseOptions(argc, argv, options))
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    auto source = screen_recorder::createSourceFromSpec(options.source, 0);
+    if (!source)
+        return 1;
+    int width = source->width() & ~1;
+    int height = source->height() & ~1;
+    int fps = source->frameRate() > 0 ? source->frameRate() : 30;
+
+    std::vector<video_encoder::EncoderSettings> grid;
+    try
+    {
+        grid = buildGrid(options, width, height, fps);
+    }
+    catch (const std::exception &)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Result> results;
+    for (size_t i = 0; i < grid.size(); i++)
+    {
+        const video_encoder::EncoderSettings &settings = grid[i];
+        std::cerr << "[" << i + 1 << "/" << grid.size() << "] " << settings.codec << " " << settings.preset << " "
+                  << rateControl(settings) << " threads=" << settings.threads << " " << settings.threadType << std::endl;
+        results.push_back(runSetting(*source, settings, options.frames));
+    }
+
+    if (!options.json.empty())
+    {
+        std::ofstream json(options.json);
+        writeJson(json, results, fps);
+    }
+    if (!options.csv.empty())
+    {
+        std::ofstream csv(options.csv);
+        writeCsv(csv, results, fps);
+    }
+    else if (options.json.empty())
+    {
+        writeCsv(std::cout, results, fps);
+    }
+    return 0;
+}